@@ -51,45 +51,10 @@ if [ -z ${bin+x} ]; then
     bin="."
 fi
 
-# crop input
-incrop=crop.png
-crop $crop $crop -$crop -$crop $IN $incrop
-crop $crop $crop -$crop -$crop $incrop $incrop
-
-# corners shifting
-w=`identify -format %w $IN`
-h=`identify -format %h $IN`
-w=$(($w-1))
-h=$(($h-1))
-hx2=`echo "$w + $hx2" | bc`
-hy3=`echo "$h + $hy3" | bc`
-hx4=`echo "$w + $hx4" | bc`
-hy4=`echo "$h + $hy4" | bc`
-
-# compute the corresponding homography
-transform=`python3 ${bin}/hom4p.py 0 0 $hx1 $hy1 $w 0 $hx2 $hy2 0 $h $hx3 $hy3 $w $h $hx4 $hy4`
-
-echo "Transformation by the homography: $transform"
-
-# direct interpolation (Line 2)
-interpolation $IN $outtiff "$transform" -i $interp -b $boundary -t 0 > /dev/null
+# transformation, crops, inverse transformation and reversibility errors
+# (Line 2 to 7) computed in memory by a single program
+reversibility $IN "$hx1 $hy1 $hx2 $hy2 $hx3 $hy3 $hx4 $hy4" -c $crop -i $interp -b $boundary -r $ratio -o $BASEOUT | grep -v "seconds"
 crop 0 0 0 0 $outtiff $outpng # trick to save png file
 
-# crop (Line 3)
-crop $crop $crop -$crop -$crop $outtiff $outtiff
-
-# inverse transformation (Line 4)
-transform2=`python3 ${bin}/translate_homography.py $transform $crop`
-interpolation $outtiff $outtiff "$transform2" -i $interp -b $boundary -t 1 > /dev/null
-
-# crop output
-crop $crop $crop -$crop -$crop $outtiff $outtiff
-
-# compute reversibility errors (Line 5 to 7)
-error=`reversibility_error $incrop $outtiff 0 -r $ratio`
-echo "Reversibility error: $error"
-error=`reversibility_error $incrop $outtiff 1 -r $ratio`
-echo "Clipped reversibility error: $error"
-
 # compute difference and fft
-python3 ${bin}/difference_and_fft.py $incrop $outtiff $outdiff $outfft
\ No newline at end of file
+python3 ${bin}/difference_and_fft.py ${BASEOUT}_crop.tiff ${BASEOUT}_inverse.tiff $outdiff $outfft
\ No newline at end of file
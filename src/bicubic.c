@@ -29,7 +29,7 @@ typedef enum
 } BoundaryExt;
 #endif
 
-typedef double (*getsample_operator)(double*,int,int,int,int);
+typedef int (*getindex_operator)(int,int);
 
 // Modulus with correct values
 static int good_modulus(int n, int p)
@@ -72,97 +72,156 @@ inline static int positive_reflex2(int i, int N) {
     }
 }
 
-// Extrapolate by reflection (hsym)
-inline
-static double getsample_hsym(double *x, int w, int h, int i, int j)
-{
-    i = positive_reflex(i, w);
-    j = positive_reflex(j, h);
-    return x[i+j*w];
-}
-
-// Extrapolate by reflection (wsym)
-inline
-static double getsample_wsym(double *x, int w, int h, int i, int j)
-{
-    i = positive_reflex2(i, w);
-    j = positive_reflex2(j, h);
-    return x[i+j*w];
-}
-
-// Extrapolate by periodicity
-inline
-static double getsample_per(double *x, int w, int h, int i, int j)
-{
-    i = good_modulus(i, w);
-    j = good_modulus(j, h);
-    return x[i+j*w];
-}
-
-// Extrapolate by constant
-inline static
-double getsample_constant(double *x, int w, int h, int i, int j)
-{
+// Clamping for constant
+inline static int clamp_index(int i, int N) {
     if (i < 0)
-        i = 0;
-    if (i >= w)
-        i = w - 1;
-    if (j < 0)
-        j = 0;
-    if (j >= h)
-        j = h - 1;
-    return x[i+j*w];
+        return 0;
+    if (i >= N)
+        return N - 1;
+    return i;
 }
 
-// Cubic interpolation
-static double cubic_interpolation(double v[4], float x)
+// Number of locations processed together by interpolate_bicubic
+// (the weights and indices of a block are computed by vectorizable loops)
+#define BICUBIC_BLOCK 64
+
+// Boundary handling function of a boundary condition
+static getindex_operator get_index_operator(BoundaryExt bc)
 {
-    return v[1] + 0.5*x*(v[2] - v[0]
-        + x*(2.0*v[0] - 5.0*v[1] + 4.0*v[2] - v[3] //x^2 term
-        + x*(3.0*(v[1] - v[2]) + v[3] - v[0])));   //x^3 term
+    if ( bc == BOUNDARY_PERIODIC )
+        return good_modulus;
+    if ( bc == BOUNDARY_CONSTANT )
+        return clamp_index;
+    if ( bc == BOUNDARY_WSYMMETRIC )
+        return positive_reflex2;
+    return positive_reflex;
 }
 
-// Bicubic interpolation
-static double bicubic_interpolation_cell(double p[4][4], float x, float y)
+// Weights of the cubic interpolation (Keys kernel with a=-1/2) of four
+// consecutive samples at the position x in [0,1) from the second one
+static inline void cubic_weights(double *w0, double *w1, double *w2, double *w3,
+                                 double x)
 {
-    double v[4];
-    v[0] = cubic_interpolation(p[0], y);
-    v[1] = cubic_interpolation(p[1], y);
-    v[2] = cubic_interpolation(p[2], y);
-    v[3] = cubic_interpolation(p[3], y);
-    return cubic_interpolation(v, x);
+    *w0 = 0.5*x*(-1.0 + x*(2.0 - x));
+    *w1 = 1.0 + 0.5*x*x*(3.0*x - 5.0);
+    *w2 = 0.5*x*(1.0 + x*(4.0 - 3.0*x));
+    *w3 = 0.5*x*x*(x - 1.0);
 }
 
 // Resampling of an image at locations (xpos,ypos) using bicubic interpolation
+// The value of the channel l at the location k is written in out[k + l*stride]
+// The locations are processed by blocks. For each location the weights and
+// the indices of the 4x4 stencil are computed once for all the channels,
+// the boundary handling being only applied to the stencils which are not
+// inside the image.
 void interpolate_bicubic(double *out, double *in, int w, int h, int pd,
                          BoundaryExt bc, double *xpos, double *ypos,
-                         int numPixels) {
-    int ix, iy;
-    double x, y, c[4][4];
-    
-    // boundary handling
-    getsample_operator p;
-    if ( bc == BOUNDARY_PERIODIC )
-        p = getsample_per;
-    if ( bc == BOUNDARY_CONSTANT )
-        p = getsample_constant;
-    if ( bc == BOUNDARY_HSYMMETRIC )
-        p = getsample_hsym;
-    if ( bc == BOUNDARY_WSYMMETRIC )
-        p = getsample_wsym;
+                         int numPixels, int stride) {
+    getindex_operator p = get_index_operator(bc);
+
+    double wx[4][BICUBIC_BLOCK], wy[4][BICUBIC_BLOCK];
+    int x0[BICUBIC_BLOCK], y0[BICUBIC_BLOCK];
+    int xi[4][BICUBIC_BLOCK], yi[4][BICUBIC_BLOCK];
+
+    for (int k0 = 0; k0 < numPixels; k0 += BICUBIC_BLOCK) {
+        int nb = (numPixels - k0 < BICUBIC_BLOCK) ? numPixels - k0 : BICUBIC_BLOCK;
+
+        // weights and indices of the stencils
+        for (int k = 0; k < nb; k++) {
+            double x = xpos[k0 + k] - 1;
+            double y = ypos[k0 + k] - 1;
+            x0[k] = floor(x);
+            y0[k] = floor(y);
+            cubic_weights(wx[0] + k, wx[1] + k, wx[2] + k, wx[3] + k, x - x0[k]);
+            cubic_weights(wy[0] + k, wy[1] + k, wy[2] + k, wy[3] + k, y - y0[k]);
+            for (int i = 0; i < 4; i++) {
+                xi[i][k] = x0[k] + i;
+                yi[i][k] = (y0[k] + i)*w;
+            }
+        }
+        for (int k = 0; k < nb; k++) {
+            if ( x0[k] < 0 || x0[k] + 3 >= w )
+                for (int i = 0; i < 4; i++)
+                    xi[i][k] = p(x0[k] + i, w);
+            if ( y0[k] < 0 || y0[k] + 3 >= h )
+                for (int i = 0; i < 4; i++)
+                    yi[i][k] = p(y0[k] + i, h)*w;
+        }
 
-    // loop over the locations
-    for (int k = 0; k < numPixels; k++) {
-        x = xpos[k] - 1;
-        y = ypos[k] - 1;
+        // interpolation of the channels (columns first, then the row)
+        for (int l = 0; l < pd; l++) {
+            const double *inl = in + l*w*h;
+            double *outl = out + k0 + l*stride;
+            for (int k = 0; k < nb; k++) {
+                double s = 0;
+                for (int i = 0; i < 4; i++) {
+                    const double *c = inl + xi[i][k];
+                    double v = wy[0][k]*c[yi[0][k]] + wy[1][k]*c[yi[1][k]]
+                             + wy[2][k]*c[yi[2][k]] + wy[3][k]*c[yi[3][k]];
+                    s += wx[i][k]*v;
+                }
+                outl[k] = s;
+            }
+        }
+    }
+}
 
-        ix = floor(x);
-        iy = floor(y);
-        for (int l = 0; l < pd; l ++) {
-            for (int j = 0; j < 4; j++)
-                for (int i = 0; i < 4; i++)
-                    c[i][j] = p(in + l*w*h, w, h, ix + i, iy + j);
-            out[k + l*numPixels] = bicubic_interpolation_cell(c, x - ix, y - iy);
+// Resampling of an image on the tensor grid xpos x ypos using bicubic interpolation
+// The output is a nx x ny image. The interpolation is computed in two 1D passes:
+// the columns are first interpolated at the ordinates ypos, then the rows of
+// the result at the abscissas xpos (the values are the same as interpolate_bicubic)
+void interpolate_bicubic_separable(double *out, double *in, int w, int h, int pd,
+                                   BoundaryExt bc, double *xpos, int nx,
+                                   double *ypos, int ny) {
+    getindex_operator p = get_index_operator(bc);
+
+    // indices of the samples and weights (computed once)
+    int *ix = malloc(4*nx*sizeof*ix);
+    int *iy = malloc(4*ny*sizeof*iy);
+    double *wx = malloc(4*nx*sizeof*wx);
+    double *wy = malloc(4*ny*sizeof*wy);
+    for (int i = 0; i < nx; i++) {
+        double x = xpos[i] - 1;
+        int x0 = floor(x);
+        cubic_weights(wx + 4*i, wx + 4*i+1, wx + 4*i+2, wx + 4*i+3, x - x0);
+        for (int k = 0; k < 4; k++)
+            ix[4*i+k] = p(x0 + k, w);
+    }
+    for (int j = 0; j < ny; j++) {
+        double y = ypos[j] - 1;
+        int y0 = floor(y);
+        cubic_weights(wy + 4*j, wy + 4*j+1, wy + 4*j+2, wy + 4*j+3, y - y0);
+        for (int k = 0; k < 4; k++)
+            iy[4*j+k] = p(y0 + k, h);
+    }
+
+    // columns interpolated at the ordinates
+    double *col = malloc(w*ny*sizeof*col);
+    for (int l = 0; l < pd; l++) {
+        double *inl = in + l*w*h;
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < ny; j++) {
+            const double *r0 = inl + iy[4*j]*w, *r1 = inl + iy[4*j+1]*w;
+            const double *r2 = inl + iy[4*j+2]*w, *r3 = inl + iy[4*j+3]*w;
+            const double *v = wy + 4*j;
+            for (int c = 0; c < w; c++)
+                col[c + j*w] = v[0]*r0[c] + v[1]*r1[c] + v[2]*r2[c] + v[3]*r3[c];
+        }
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < ny; j++) {
+            const double *r = col + j*w;
+            for (int i = 0; i < nx; i++) {
+                double s = 0;
+                for (int k = 0; k < 4; k++)
+                    s += wx[4*i+k]*r[ix[4*i+k]];
+                out[i + j*nx + l*nx*ny] = s;
+            }
         }
     }
+
+    free(ix);
+    free(iy);
+    free(wx);
+    free(wy);
+    free(col);
 }
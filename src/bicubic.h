@@ -20,6 +20,10 @@
 // Resampling of an image at locations (xpos,ypos) using bicubic interpolation 
 void interpolate_bicubic(double *out, double *in, int w, int h, int pd,
                          BoundaryExt bc, double *xpos, double *ypos,
-                         int numPixels);
+                         int numPixels, int stride);
+// Resampling of an image on the tensor grid xpos x ypos using bicubic interpolation
+void interpolate_bicubic_separable(double *out, double *in, int w, int h, int pd,
+                                   BoundaryExt bc, double *xpos, int nx,
+                                   double *ypos, int ny);
 
 #endif
@@ -21,7 +21,7 @@
 #include <math.h>
 
 // Projection of x onto [min, max]
-static int clip(int x, int min, int max)
+static inline int clip(int x, int min, int max)
 {
     if (x < min) return min;
     if (x > max) return max;
@@ -29,8 +29,35 @@ static int clip(int x, int min, int max)
 }
 
 // Cropping of an image
-static void crop(float *out, int *cw, int *ch, float *in, int w, int h, int pd,
-                 int x0, int y0, int xf, int yf)
+static inline void crop(float *out, int *cw, int *ch, float *in, int w, int h, int pd,
+                        int x0, int y0, int xf, int yf)
+{
+    // if non-positive update
+    if (xf <= 0)
+        xf = w + xf;
+    if (yf <= 0)
+        yf = h + yf;
+    
+    // adjust bounds
+    x0 = clip(x0, 0, w);
+    xf = clip(xf, 0, w);
+    y0 = clip(y0, 0, h);
+    yf = clip(yf, 0, h);
+
+    // output size
+    *cw = xf - x0;
+    *ch = yf - y0;
+
+    // compute crop
+    for (int l = 0; l < pd; l++)
+        for (int j = 0; j < *ch; j++)
+            for (int i = 0; i < *cw; i++)
+                out[i + j*(*cw) + l*(*cw)*(*ch)] = in[i+x0 + (j+y0)*w + l*w*h];
+}
+
+// Cropping of an image (double precision)
+static inline void crop_double(double *out, int *cw, int *ch, double *in, int w, int h, int pd,
+                               int x0, int y0, int xf, int yf)
 {
     // if non-positive update
     if (xf <= 0)
@@ -56,7 +83,7 @@ static void crop(float *out, int *cw, int *ch, float *in, int w, int h, int pd,
 }
 
 // Compute the root mean square error (RMSE) of an array
-static double rmse(double *in, int N) {
+static inline double rmse(double *in, int N) {
     
     double val = 0.0;
     for (int i=0; i<N; i++)
@@ -245,6 +245,54 @@ void compute_bspline_poly(double* C, int n) {
     free(jPi);
 }
 
+/// \brief Fill \a T with the polynomial coefficients of the kernel taps.
+/// \details The interpolation at x uses the n+1 taps x-(x0+k), 0<=k<=n, with
+/// x0 = ceil(x-(n+1)/2). Writing f = x-x0-(n-1)/2, which lies in (0,1], each
+/// tap stays in a fixed interval of the B-spline, whose polynomial is
+/// evaluated at y_k = a_k + s_k f. T is the concatenation of the arrays
+/// a[n+1], s[n+1] and P[(n+1)*(n+1)], where P[j*(n+1)+k] is the coefficient
+/// of y_k^j, so that all the taps can be evaluated in lockstep (Horner).
+/// The coefficients are the ones of \ref compute_bspline_poly (n>0).
+void compute_bspline_taps(double* T, int n) {
+    const int tn = n/2, n1 = n+1;
+    const double radius = 0.5*(n+1);
+    double* C = malloc((n1*tn+(int)floor(radius)+1)*sizeof*C);
+    compute_bspline_poly(C, n);
+
+    double *a = T, *s = T+n1, *P = T+2*n1;
+    for(int k=0; k<=n; k++) {
+        double c0 = radius-1-k; // tap k is c0+f
+        int i; // interval of the B-spline
+        if(c0 >= 0) { // positive tap, |x| = c0+f
+            i = k;
+            a[k] = (i<tn)? 1: 0;
+            s[k] = (i<tn)? -1: 1;
+        } else if(c0 <= -1) { // negative tap, |x| = -c0-f
+            i = n-k;
+            a[k] = (i<tn)? 0: 1;
+            s[k] = (i<tn)? 1: -1;
+        } else { // central tap (even n), x = f-1/2
+            i = tn;
+            a[k] = c0;
+            s[k] = 1;
+        }
+
+        if(i < tn) // polynomial in y = (n+1)/2-i-|x|
+            for(int j=0; j<=n; j++)
+                P[j*n1+k] = C[j+n1*i];
+        else { // even-degree monomials (and n if odd) in |x|
+            for(int j=0; j<=n; j++)
+                P[j*n1+k] = 0;
+            for(int j=0; j<=tn; j++)
+                P[2*j*n1+k] = C[j+n1*tn];
+            if(n%2 == 1)
+                P[n*n1+k] = C[tn+1+n1*tn];
+        }
+    }
+
+    free(C);
+}
+
 /// \brief Evaluate Bspline at point \a x.
 /// \details Find the length-1 interval x is in, wich yields the polynomial
 /// coefficients to use. Evaluate with Horner's method.
@@ -23,6 +23,14 @@
 #define MAX_TABULATED_ORDER 11 ///< Maximum order of tabulated splines
 #define MAX_ORDER 16 ///< Max spline order with guaranty of truncation precision
 
+/// Type of the stored prefiltered coefficients (the prefiltering itself is
+/// computed in double precision)
+#ifdef SINGLE_PRECISION
+typedef float coef_t;
+#else
+typedef double coef_t;
+#endif
+
 /** Info for B-spline prefiltering */
 typedef struct {
     int nPoles; ///< Number of poles = [order/2]
@@ -42,6 +50,7 @@ struct Bspline_s {
 };
 
 void compute_bspline_poly(double* C, int n);
+void compute_bspline_taps(double* T, int n);
 void compute_ztrans_coeff(double* ztransCoeff, int n);
 void compute_poles(double* poles, const double* ztransCoeff, int n);
 
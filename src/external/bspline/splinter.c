@@ -42,12 +42,17 @@ typedef enum {
 /// (x,y), can then be performed.
 /// At the end, disposal is achieved by \ref splinter_destroy_plan.
 typedef struct {
-    double* prefilt; ///< prefiltered image
+    coef_t* prefilt; ///< prefiltered image, with a ghost border
     int w,h,c; ///< width,height,channels
+    int border; ///< width of the ghost border of the prefiltered image
+    int bw,bh; ///< dimensions of the prefiltered image with its border
     int shift; ///< shift in each channel
     Bspline* bspline; ///< Bspline kernel
     int (*ext)(int, int); ///< get pixels of extended image
     double *xBuf, *yBuf; ///< buffers for computation (internal usage)
+    double* taps; ///< polynomials of the kernel taps (NULL for order 0)
+    void (*dot)(double*, const coef_t*, int, int, int, int,
+                const double*, const double*); ///< evaluation kernel
 } splinter_plan_t;
 
 // ********************** boundary condition **********************************
@@ -115,11 +120,19 @@ static int (*ExtensionMethod[4])(int, int) =
 
 // ********************** prefiltering exact domain ***************************
 
+/// \brief Number of signals filtered in lockstep by the exponential filters
+#define PREFILTER_BLOCK 8
+
 /// \brief 1D in-place exponential filter with a recursive filter pair
 /// \details This is Algorithm 3 in the IPOL article.
+/// The nb signals data[b+i*step] (0 <= b < nb, 0 <= i < n) are filtered in
+/// lockstep, so that the innermost loops run over adjacent memory locations
+/// (and can be vectorized). Each signal is filtered exactly as if it was
+/// filtered alone.
 /// \param data pointer to data to be filtered
-/// \param step stride between successive elements of \a data
-/// \param n number of samples of \a data
+/// \param step stride between successive elements of each signal
+/// \param n number of samples of each signal
+/// \param nb number of adjacent signals (at most PREFILTER_BLOCK)
 /// \param boundary the kind of boundary handling to use
 /// \param alpha filter coefficient
 /// \param n0 truncation index for initial values
@@ -135,9 +148,12 @@ static int (*ExtensionMethod[4])(int, int) =
 /// is exact for constant extension.  Note, however, that for constant extension
 /// the infinite grid result is not exactly constant beyond the boundaries
 /// (rather it decays to constant).
-static void expFilter(double *data, int step, int n,
+static void expFilter(double *data, int step, int n, int nb,
                       BoundaryExt boundary, double alpha, int n0) {
-    double powAlpha=1, last=data[0];
+    double powAlpha=1, last[PREFILTER_BLOCK];
+    int b;
+    for(b=0; b<nb; b++)
+        last[b] = data[b];
 
     // avoid too large initialization
     if(n0 > n)
@@ -148,155 +164,231 @@ static void expFilter(double *data, int step, int n,
     // Causal init
     switch(boundary) {
     case BOUNDARY_CONSTANT:
-        last /= 1-alpha;
+        for(b=0; b<nb; b++)
+            last[b] /= 1-alpha;
         break;
     case BOUNDARY_HSYMMETRIC:
         for(i=0; i<iEnd; i+=step) {
             powAlpha *= alpha;
-            last += data[i]*powAlpha;
+            for(b=0; b<nb; b++)
+                last[b] += data[i+b]*powAlpha;
         }
         break;
     case BOUNDARY_WSYMMETRIC:
         for(i=step; i<=iEnd; i+=step) {
             powAlpha *= alpha;
-            last += data[i]*powAlpha;
+            for(b=0; b<nb; b++)
+                last[b] += data[i+b]*powAlpha;
         }
         break;
     case BOUNDARY_PERIODIC:
         for(i=step; i<=iEnd; i+=step) {
             powAlpha *= alpha;
-            last += data[step*n-i]*powAlpha;
+            for(b=0; b<nb; b++)
+                last[b] += data[step*n-i+b]*powAlpha;
         }
         break;
     default: assert(0); // Should never go here
         break;
     }
-    data[0] = last;
+    for(b=0; b<nb; b++)
+        data[b] = last[b];
 
     // Causal filter
     iEnd = (n-1)*step;
-    for(i=step; i<iEnd; i+=step) {
-        data[i] += alpha*last;
-        last = data[i];
-    }
+    for(i=step; i<iEnd; i+=step)
+        for(b=0; b<nb; b++) {
+            data[i+b] += alpha*last[b];
+            last[b] = data[i+b];
+        }
 
     // Anti-causal init
+    double *d = data + iEnd;
     switch(boundary) {
     case BOUNDARY_CONSTANT:
-        data[iEnd] = last = (alpha*(-data[iEnd] + (alpha - 1)*alpha*last))
-            /((alpha - 1)*(alpha*alpha - 1));
+        for(b=0; b<nb; b++)
+            d[b] = last[b] = (alpha*(-d[b] + (alpha - 1)*alpha*last[b]))
+                /((alpha - 1)*(alpha*alpha - 1));
         break;
     case BOUNDARY_HSYMMETRIC:
-        data[iEnd] += alpha*last;
-        last = data[iEnd] *= alpha/(alpha - 1);
+        for(b=0; b<nb; b++) {
+            d[b] += alpha*last[b];
+            last[b] = d[b] *= alpha/(alpha - 1);
+        }
         break;
     case BOUNDARY_WSYMMETRIC:
-        data[iEnd] += alpha*last;
-        data[iEnd] = last = (alpha/(alpha*alpha - 1))
-            * ( data[iEnd] + alpha*data[iEnd - step] );
+        for(b=0; b<nb; b++) {
+            d[b] += alpha*last[b];
+            d[b] = last[b] = (alpha/(alpha*alpha - 1))
+                * ( d[b] + alpha*d[b - step] );
+        }
         break;
     case BOUNDARY_PERIODIC:
-        data[iEnd] += alpha*last;
-        last = data[iEnd];
+        for(b=0; b<nb; b++) {
+            d[b] += alpha*last[b];
+            last[b] = d[b];
+        }
         powAlpha = 1;
         for(i=0; i<n0*step; i+=step) {
             powAlpha *= alpha;
-            last += data[i]*powAlpha;
+            for(b=0; b<nb; b++)
+                last[b] += data[i+b]*powAlpha;
         }
-        data[iEnd] = last *= -alpha;
+        for(b=0; b<nb; b++)
+            d[b] = last[b] *= -alpha;
         break;
     }
     // Anti-causal filter
-    for(i=iEnd-step; i>=0; i-=step) {
-        data[i] = alpha*(last - data[i]);
-        last = data[i];
-    }
+    for(i=iEnd-step; i>=0; i-=step)
+        for(b=0; b<nb; b++) {
+            data[i+b] = alpha*(last[b] - data[i+b]);
+            last[b] = data[i+b];
+        }
+}
+
+/// \brief Copy nb rows of length n into a buffer with interleaved rows
+/// \details The sample i of row b is stored in buf[b+i*nb] (tiled transpose),
+/// so that the rows can be filtered in lockstep with step nb.
+static void interleave_rows(double* buf, const double* data, int w, int n,
+                            int nb) {
+    for(int b=0; b<nb; b++)
+        for(int i=0; i<n; i++)
+            buf[b+i*nb] = data[i+b*w];
+}
+
+/// \brief Inverse of \ref interleave_rows
+static void deinterleave_rows(double* data, const double* buf, int w, int n,
+                              int nb) {
+    for(int b=0; b<nb; b++)
+        for(int i=0; i<n; i++)
+            data[i+b*w] = buf[b+i*nb];
 }
 
 /// \brief Apply a cascade of exponential filters to an image
 /// \details This is Algorithm 5 in the IPOL article.
-/// \param data the image data
+/// The columns are filtered by blocks of PREFILTER_BLOCK adjacent columns and
+/// the rows by blocks of PREFILTER_BLOCK rows after a tiled transpose. The
+/// blocks of all the channels are filtered in parallel.
+/// \param data the image data (planar channels)
 /// \param w,h image dimensions
+/// \param nc number of channels
 /// \param boundary the kind of boundary handling to use
 /// \param m structure with poles and number of poles
 /// \param truncation array of truncation values in the initializations
-static void prefiltering(double* data, int w, int h, BoundaryExt boundary,
-                         const prefilter_t* m, const int* truncation) {
-    int x, y, k;
+static void prefiltering(double* data, int w, int h, int nc,
+                         BoundaryExt boundary, const prefilter_t* m,
+                         const int* truncation) {
+    const int B = PREFILTER_BLOCK;
 
     // Prefiltering of the columns
-    for(x = 0; x < w; x++)
-        for(k = 0; k < m->nPoles; k++)
-            expFilter(data + x, w, h, boundary, m->poles[k], truncation[k]);
+    #pragma omp parallel for collapse(2) schedule(static)
+    for(int l = 0; l < nc; l++)
+        for(int x = 0; x < w; x += B) {
+            int nb = (w-x < B)? w-x: B;
+            for(int k = 0; k < m->nPoles; k++)
+                expFilter(data + l*w*h + x, w, h, nb, boundary, m->poles[k],
+                          truncation[k]);
+        }
 
     // Prefiltering of the rows
-    for(y = 0; y < h; y++)
-        for(k = 0; k < m->nPoles; k++)
-            expFilter(data+w*y, 1, w, boundary, m->poles[k], truncation[k]);
+    #pragma omp parallel
+    {
+        double* buf = malloc(B*w*sizeof*buf);
+        #pragma omp for collapse(2) schedule(static)
+        for(int l = 0; l < nc; l++)
+            for(int y = 0; y < h; y += B) {
+                int nb = (h-y < B)? h-y: B;
+                double* row = data + l*w*h + w*y;
+                interleave_rows(buf, row, w, w, nb);
+                for(int k = 0; k < m->nPoles; k++)
+                    expFilter(buf, nb, w, nb, boundary, m->poles[k],
+                              truncation[k]);
+                deinterleave_rows(row, buf, w, w, nb);
+            }
+        free(buf);
+    }
 
     // Normalization, twice because 2D
     if(m->normalization != 1) {
         unsigned long long factor = m->normalization*m->normalization;
-        for(k = 0; k < w*h; k++)
+        #pragma omp parallel for schedule(static)
+        for(int k = 0; k < w*h*nc; k++)
             data[k] *= factor;
     }
 }
 
 /// \brief 1D in-place exp filter with a recursive filter pair (larger domain)
 /// \details This is Algorithm 3 in the IPOL article.
+/// The nb signals data[b+i*step] are filtered in lockstep (see \ref expFilter).
 /// \param data pointer to data to be filtered
-/// \param step stride between successive elements of \a data
-/// \param n number of samples of \a data
+/// \param step stride between successive elements of each signal
+/// \param n number of samples of each signal
+/// \param nb number of adjacent signals (at most PREFILTER_BLOCK)
 /// \param alpha filter coefficient
 /// \param n0 truncation index for initial values
-static void expFilterExt(double *data, int step, int n, double alpha, int n0) {
-    int i, iIni = n0*step, iEnd = (n-1-n0)*step;
+static void expFilterExt(double *data, int step, int n, int nb, double alpha,
+                         int n0) {
+    int i, b, iIni = n0*step, iEnd = (n-1-n0)*step;
+    double last[PREFILTER_BLOCK], sum[PREFILTER_BLOCK];
 
     // Initialisation at point n0 using the n0 first values
-    double powAlpha=1, last=data[iIni];
+    double powAlpha=1;
+    for(b=0; b<nb; b++)
+        last[b] = data[iIni+b];
     for(i=iIni-step; i>=0; i-=step) {
       powAlpha *= alpha;
-      last += powAlpha*data[i];
+      for(b=0; b<nb; b++)
+          last[b] += powAlpha*data[i+b];
     }
-    data[iIni] = last;
+    for(b=0; b<nb; b++)
+        data[iIni+b] = last[b];
 
     // Computation for the anti-causal initialization at n-1-n0
-    double sum = 0;
     powAlpha = 1;
+    for(b=0; b<nb; b++)
+        sum[b] = 0;
     for(i=iEnd+step; i<=(n-1)*step; i+=step) {
       powAlpha *= alpha;
-      sum += powAlpha*data[i];
+      for(b=0; b<nb; b++)
+          sum[b] += powAlpha*data[i+b];
     }
 
     // Causal filtering from n0 to iEnd
-    for(i=iIni+step; i<=iEnd; i+=step) {
-        data[i] += alpha*last;
-        last = data[i];
-    }
+    for(i=iIni+step; i<=iEnd; i+=step)
+        for(b=0; b<nb; b++) {
+            data[i+b] += alpha*last[b];
+            last[b] = data[i+b];
+        }
 
     // Initialization at point n-1-n0
-    last = data[iEnd] = alpha/(alpha*alpha-1)*(last+sum);
+    for(b=0; b<nb; b++)
+        last[b] = data[iEnd+b] = alpha/(alpha*alpha-1)*(last[b]+sum[b]);
 
     // Anti-causal filtering
-    for(i=iEnd-step; i>=iIni; i-=step) {
-        data[i] = alpha*(last - data[i]);
-        last = data[i];
-    }
+    for(i=iEnd-step; i>=iIni; i-=step)
+        for(b=0; b<nb; b++) {
+            data[i+b] = alpha*(last[b] - data[i+b]);
+            last[b] = data[i+b];
+        }
 }
 
 /// \brief Apply a cascade of exponential filters to an image (larger domain)
 /// \details This is Algorithm 4 in the IPOL article.
-/// \param data the image data
+/// The columns and rows are filtered by blocks as in \ref prefiltering and
+/// the blocks of all the channels are filtered in parallel.
+/// \param prefilt the extended image data (planar channels)
+/// \param data the image data (planar channels)
 /// \param w,h image dimensions
+/// \param nc number of channels
 /// \param boundary the kind of boundary handling to use
 /// \param m structure with poles and number of poles
 /// \param truncation array of truncation values in the initializations
 /// \param Lprecision array of larger domain extensions
 static void prefilteringExt(double* prefilt, const double* data,int w,int h,
-                            BoundaryExt boundary,
+                            int nc, BoundaryExt boundary,
                             const prefilter_t* m, const int* truncation,
                             const int* Lprecision) {
-    int k, x, y;
+    const int B = PREFILTER_BLOCK;
     int nPoles = m->nPoles;
     // extended domain sizes
     int L2 = Lprecision[0];
@@ -305,45 +397,169 @@ static void prefilteringExt(double* prefilt, const double* data,int w,int h,
 
     // extend the input data
     int (*Extension)(int, int) = ExtensionMethod[boundary];
-    for(y=0; y<h2; y++) {
-        int y0 = ((0<=y-L2 && y-L2<h)? y-L2: Extension(h,y-L2));
-        int offset0 = w*y0;
-        int offset = w2*y;
-        for(x=0; x<w2; x++){
-            int x0 = ((0<=x-L2 && x-L2<w)? x-L2: Extension(w,x-L2));
-            prefilt[x+offset] = data[x0+offset0];
-      }
-    }
+    #pragma omp parallel for collapse(2) schedule(static)
+    for(int l=0; l<nc; l++)
+        for(int y=0; y<h2; y++) {
+            int y0 = ((0<=y-L2 && y-L2<h)? y-L2: Extension(h,y-L2));
+            int offset0 = w*y0 + l*w*h;
+            int offset = w2*y + l*w2*h2;
+            for(int x=0; x<w2; x++){
+                int x0 = ((0<=x-L2 && x-L2<w)? x-L2: Extension(w,x-L2));
+                prefilt[x+offset] = data[x0+offset0];
+          }
+        }
 
     // L2-Lprecision[k] = sum_{i=0}^{k-1} truncation[i] is the length of values
     // that are not used for computing the k-th application of exp filter
     if(nPoles > 0) { // security check
         // prefiltering of the columns
-        for(x = 0; x < w2; x++)
-            for(k = 0; k < nPoles; k++)
-                expFilterExt(prefilt+x+(L2-Lprecision[k])*w2, w2,
-                             h2-2*(L2-Lprecision[k]),
-                             m->poles[k], truncation[k]);
+        #pragma omp parallel for collapse(2) schedule(static)
+        for(int l = 0; l < nc; l++)
+            for(int x = 0; x < w2; x += B) {
+                int nb = (w2-x < B)? w2-x: B;
+                for(int k = 0; k < nPoles; k++)
+                    expFilterExt(prefilt+l*w2*h2+x+(L2-Lprecision[k])*w2, w2,
+                                 h2-2*(L2-Lprecision[k]), nb,
+                                 m->poles[k], truncation[k]);
+            }
 
         // prefiltering of the rows, needs to be computed only from
         // L3 = sum(truncation[i]) to h2-L3
         int L3 = L2-Lprecision[nPoles];
-        for(y=L3; y < h2-L3; y++)
-            for(k = 0; k < nPoles; k++)
-                expFilterExt(prefilt + w2*y + (L2-Lprecision[k]), 1,
-                             w2-2*(L2-Lprecision[k]),
-                             m->poles[k], truncation[k]);
+        #pragma omp parallel
+        {
+            double* buf = malloc(B*w2*sizeof*buf);
+            #pragma omp for collapse(2) schedule(static)
+            for(int l = 0; l < nc; l++)
+                for(int y=L3; y < h2-L3; y += B) {
+                    int nb = (h2-L3-y < B)? h2-L3-y: B;
+                    double* row = prefilt + l*w2*h2 + w2*y;
+                    interleave_rows(buf, row, w2, w2, nb);
+                    for(int k = 0; k < nPoles; k++)
+                        expFilterExt(buf + (L2-Lprecision[k])*nb, nb,
+                                     w2-2*(L2-Lprecision[k]), nb,
+                                     m->poles[k], truncation[k]);
+                    deinterleave_rows(row, buf, w2, w2, nb);
+                }
+            free(buf);
+        }
 
         // renormalization
         if(m->normalization != 1) {
             unsigned long long factor = m->normalization*m->normalization;
-            for(y=L3; y < h2-L3; y++)
-                for(x=L3; x < w2-L3; x++)
-                    prefilt[x+w2*y] *= factor;
+            #pragma omp parallel for collapse(2) schedule(static)
+            for(int l = 0; l < nc; l++)
+                for(int y=L3; y < h2-L3; y++)
+                    for(int x=L3; x < w2-L3; x++)
+                        prefilt[x+w2*y+l*w2*h2] *= factor;
         }
     }
 }
 
+/// \brief Index of the prefiltered sample used at index \a i of a line.
+/// \details This applies the boundary extension outside of the domain where
+/// the prefiltering was computed.
+/// \param N the length of the line (plan->w or plan->h)
+static inline int splinter_index(const splinter_plan_t* plan, int N, int i) {
+    const int shift = plan->shift;
+    // Shift for handling boundary condition properly in case of extrapolation
+    const int shift2 = (shift-plan->bspline->tn>0)? shift-plan->bspline->tn: 0;
+    return (shift2<=i && i<N-shift2)? i: plan->ext(N-2*shift, i-shift)+shift;
+}
+
+/// \brief Surround the prefiltered image with a ghost border.
+/// \details The border contains the samples given by the boundary extension,
+/// so that the kernel can be applied near the boundary without remapping the
+/// indices. The prefiltered image \a prefilt is freed.
+static void add_ghost_border(splinter_plan_t* plan, double* prefilt) {
+    const int w = plan->w, h = plan->h, b = plan->border;
+    const int bw = plan->bw, bh = plan->bh;
+    coef_t* ghost = malloc(bw*bh*plan->c*sizeof*ghost);
+
+    int* xI = malloc(bw*sizeof*xI);
+    for(int i=0; i<bw; i++)
+        xI[i] = splinter_index(plan, w, i-b);
+
+    #pragma omp parallel for collapse(2) schedule(static)
+    for(int l=0; l<plan->c; l++)
+        for(int j=0; j<bh; j++) {
+            const double* in = prefilt + w*splinter_index(plan, h, j-b) + l*w*h;
+            coef_t* out = ghost + bw*j + l*bw*bh;
+            for(int i=0; i<bw; i++)
+                out[i] = in[xI[i]];
+        }
+
+    free(xI);
+    free(prefilt);
+    plan->prefilt = ghost;
+}
+
+// ********************** evaluation kernels **********************************
+
+/// \brief Generic evaluation kernel
+/// \details Accumulates in out[c] (0 <= c < nc) the separable convolution of
+/// the kWidth x kWidth samples p[k+l*bw+c*size] with the kernel values
+/// xBuf[k]*yBuf[l].
+static void splinter_dot(double* out, const coef_t* p, int bw, int size,
+                         int nc, int kWidth,
+                         const double* xBuf, const double* yBuf) {
+    for(int c=0; c<nc; c++, p += size) {
+        const coef_t* q = p;
+        for(int l=0; l<kWidth; l++, q += bw) {
+            double s=0;
+            for(int k=0; k<kWidth; k++)
+                s += q[k]*xBuf[k];
+            out[c] += s*yBuf[l];
+        }
+    }
+}
+
+/// \brief Evaluation kernel of width KW
+/// \details The loops have a constant trip count and are fully unrolled.
+/// The summation order is the one of \ref splinter_dot, so that the results
+/// do not depend on the kernel.
+#define SPLINTER_DOT(NAME, KW)                                                \
+static void NAME(double* out, const coef_t* p, int bw, int size, int nc,      \
+                 int kWidth, const double* xBuf, const double* yBuf) {        \
+    (void) kWidth;                                                            \
+    for(int c=0; c<nc; c++, p += size) {                                      \
+        const coef_t* q = p;                                                  \
+        for(int l=0; l<KW; l++, q += bw) {                                    \
+            double s=0;                                                       \
+            for(int k=0; k<KW; k++)                                           \
+                s += q[k]*xBuf[k];                                            \
+            out[c] += s*yBuf[l];                                              \
+        }                                                                     \
+    }                                                                         \
+}
+
+SPLINTER_DOT(splinter_dot2, 2)
+SPLINTER_DOT(splinter_dot3, 3)
+SPLINTER_DOT(splinter_dot4, 4)
+SPLINTER_DOT(splinter_dot5, 5)
+SPLINTER_DOT(splinter_dot6, 6)
+SPLINTER_DOT(splinter_dot7, 7)
+SPLINTER_DOT(splinter_dot8, 8)
+SPLINTER_DOT(splinter_dot9, 9)
+SPLINTER_DOT(splinter_dot10, 10)
+SPLINTER_DOT(splinter_dot11, 11)
+SPLINTER_DOT(splinter_dot12, 12)
+
+/// \brief Evaluation kernels of the tabulated orders (indexed by the order)
+static void (*const splinter_dots[MAX_TABULATED_ORDER+1])
+    (double*, const coef_t*, int, int, int, int,
+     const double*, const double*) = {
+    splinter_dot2, splinter_dot2, splinter_dot3, splinter_dot4, splinter_dot5,
+    splinter_dot6, splinter_dot7, splinter_dot8, splinter_dot9, splinter_dot10,
+    splinter_dot11, splinter_dot12};
+
+/// \brief Select the evaluation kernel of an order.
+static void (*splinter_select_dot(int order))
+    (double*, const coef_t*, int, int, int, int,
+     const double*, const double*) {
+    return (order > MAX_TABULATED_ORDER)? splinter_dot: splinter_dots[order];
+}
+
 /// \brief Create a plan for spline interpolation.
 /// \details This performs the prefiltering of the image and stores the result.
 /// After usage by calls to function \ref splinter, the plan must be disposed of
@@ -390,26 +606,38 @@ splinter_plan_t splinter_plan(const double* in, int w, int h, int c,
         plan.h += 2*plan.shift;
     }
 
-    plan.prefilt = malloc(plan.w*plan.h*c*sizeof*plan.prefilt);
+    double* prefilt = malloc(plan.w*plan.h*c*sizeof*prefilt);
     if(! larger)
-        memcpy(plan.prefilt, in, w*h*c*sizeof(double));
-    for(int l=0; l<c; l++) {
-        if(larger)
-            prefilteringExt(plan.prefilt+l*plan.w*plan.h, in+l*w*h, w, h,
-                            e, &prefilter, truncation, Lprecision);
-        else
-            prefiltering(plan.prefilt+l*plan.w*plan.h, w, h,
-                         e, &prefilter, truncation);
-    }
+        memcpy(prefilt, in, w*h*c*sizeof(double));
+    if(larger)
+        prefilteringExt(prefilt, in, w, h, c,
+                        e, &prefilter, truncation, Lprecision);
+    else
+        prefiltering(prefilt, w, h, c, e, &prefilter, truncation);
     if(order > MAX_TABULATED_ORDER)
         free(prefilter.poles);
 
     plan.ext = ExtensionMethod[e];
     // B-spline of order 0 does not vanish at its support bounds
     int kWidth = (order==0)? 2: order+1;
+
+    plan.dot = splinter_select_dot(order);
+
+    // ghost border, large enough for evaluations in the image domain
+    plan.border = kWidth;
+    plan.bw = plan.w + 2*plan.border;
+    plan.bh = plan.h + 2*plan.border;
+    add_ghost_border(&plan, prefilt);
     plan.xBuf = malloc(kWidth*sizeof*plan.xBuf);
     plan.yBuf = malloc(kWidth*sizeof*plan.yBuf);
 
+    // polynomials of the taps (order 0 is discontinuous and uses the kernel)
+    plan.taps = NULL;
+    if(order > 0 && order <= MAX_ORDER) {
+        plan.taps = malloc((kWidth+2)*kWidth*sizeof*plan.taps);
+        compute_bspline_taps(plan.taps, order);
+    }
+
     free(Lprecision);
     free(truncation);
     return plan;
@@ -424,6 +652,96 @@ void splinter_destroy_plan(splinter_plan_t plan) {
     free(plan.prefilt);
     free(plan.xBuf);
     free(plan.yBuf);
+    free(plan.taps);
+}
+
+/// \brief Evaluate the kernel at the taps x-(x0+k), 0<=k<kWidth.
+/// \details The taps are evaluated at once by lockstep Horner schemes on the
+/// polynomials given by \ref compute_bspline_taps (no branch, vectorizable).
+/// For order 0 the kernel function is used.
+static inline void splinter_weights(double* w, double x, int x0,
+                                    const splinter_plan_t* plan) {
+    const int n = plan->bspline->order;
+    if(! plan->taps) {
+        const int kWidth = (n==0)? 2: n+1;
+        for(int k = 0; k < kWidth; k++)
+            w[k] = plan->bspline->eval(x-(x0+k), plan->bspline);
+        return;
+    }
+
+    const int kWidth = n+1;
+    const double f = (x-x0) - (plan->bspline->radius-1);
+    const double *a = plan->taps, *s = a+kWidth, *P = s+kWidth;
+    double y[MAX_ORDER+1];
+    for(int k = 0; k < kWidth; k++) {
+        y[k] = a[k] + s[k]*f;
+        w[k] = P[n*kWidth+k];
+    }
+    for(int j = n-1; j >= 0; j--) {
+        const double* Pj = P + j*kWidth;
+        for(int k = 0; k < kWidth; k++)
+            w[k] = Pj[k] + w[k]*y[k];
+    }
+}
+
+/// \brief Width of the interpolation kernel of a plan.
+/// \details This is the size of each of the buffers given to \ref splinter_r.
+int splinter_kernel_width(const splinter_plan_t* plan) {
+    // B-spline of order 0 does not vanish at its support bounds
+    return (plan->bspline->order==0)? 2: plan->bspline->order+1;
+}
+
+/// \brief Perform spline interpolation at coordinates (x,y) (reentrant).
+/// \details Same as \ref splinter, except that the kernel values are stored
+/// in buffers given by the caller instead of the buffers of the plan, so that
+/// a plan can be shared by several threads.
+/// \param xBuf,yBuf buffers of size \ref splinter_kernel_width.
+void splinter_r(double* out, double x, double y, const splinter_plan_t* plan,
+                double* xBuf, double* yBuf) {
+    double radius = plan->bspline->radius;
+
+    const int kWidth = splinter_kernel_width(plan);
+
+    const int shift = plan->shift;
+    x += shift;
+    y += shift;
+
+    for(int c=0; c<plan->c; c++)
+        out[c]=0;
+    int inside = shift<=x && x<=plan->w-1-shift && shift<=y && y<=plan->h-1-shift;
+    inside=1; // Uncomment to extrapolate
+    if(! inside)
+        return;
+    // Evaluate the kernel
+    int x0 = ceil(x-radius), y0 = ceil(y-radius);
+    splinter_weights(xBuf, x, x0, plan);
+    splinter_weights(yBuf, y, y0, plan);
+
+    const int b = plan->border, bw = plan->bw, size = plan->bw*plan->bh;
+    const coef_t* prefilt = plan->prefilt + b + bw*b;
+
+    // Compute the interpolated value at (x,y)
+    if(-b<=x0 && x0+kWidth<=plan->w+b && -b<=y0 && y0+kWidth<=plan->h+b) {
+        // the samples are in the ghost border: contiguous dot products
+        plan->dot(out, prefilt + x0 + bw*y0, bw, size, plan->c, kWidth,
+                  xBuf, yBuf);
+        return;
+    }
+
+    for(int l=0; l<kWidth; l++) {
+        int iY = splinter_index(plan, plan->h, y0+l);
+        int rowOffset = bw*iY;
+
+        for(int c=0; c<plan->c; c++) {
+            double s=0;
+            for(int k=0; k<kWidth; k++) {
+                int iX = splinter_index(plan, plan->w, x0+k);
+                s += prefilt[iX+rowOffset]*xBuf[k];
+            }
+            out[c] += s*yBuf[l];
+            rowOffset += size;
+        }
+    }
 }
 
 /// \brief Perform spline interpolation at coordinates (x,y).
@@ -439,46 +757,101 @@ void splinter_destroy_plan(splinter_plan_t plan) {
 /// \param plan the plan create with \ref splinter_plan.
 /// \details This is Algorithm 7 in the IPOL article.
 void splinter(double* out, double x, double y, splinter_plan_t plan) {
-    double (*betan)(double, const Bspline*) = plan.bspline->eval;
+    splinter_r(out, x, y, &plan, plan.xBuf, plan.yBuf);
+}
+
+/// \brief Perform spline interpolation on the tensor grid x times y.
+/// \details The kernel values are computed once for each abscissa and each
+/// ordinate, and the interpolation is computed in two 1D passes: the rows of
+/// the prefiltered image are first interpolated at the abscissas, then the
+/// columns of the result at the ordinates. The values are the same as the ones
+/// given by \ref splinter at the points (x[i],y[j]).
+/// \param out the array where output values are stored, in planar form
+/// (the value of channel c at (x[i],y[j]) is out[i+j*nx+c*nx*ny]).
+/// \param x,nx abscissas of the grid and their number.
+/// \param y,ny ordinates of the grid and their number.
+/// \param plan the plan create with \ref splinter_plan.
+void splinter_grid(double* out, const double* x, int nx, const double* y,
+                   int ny, splinter_plan_t plan) {
     double radius = plan.bspline->radius;
 
     // B-spline of order 0 does not vanish at its support bounds
     const int kWidth = (plan.bspline->order==0)? 2: plan.bspline->order+1;
 
     const int shift = plan.shift;
-    // Shift for handling boundary condition properly in case of extrapolation
-    int shift2 = (shift-plan.bspline->tn>0)? shift-plan.bspline->tn: 0;
-    x += shift;
-    y += shift;
-
-    for(int c=0; c<plan.c; c++)
-        out[c]=0;
-    int inside = shift<=x && x<=plan.w-1-shift && shift<=y && y<=plan.h-1-shift;
-    inside=1; // Uncomment to extrapolate
-    if(! inside)
-        return;
-    // Evaluate the kernel
-    int x0 = ceil(x-radius), y0 = ceil(y-radius);
-    for(int k = 0; k < kWidth; k++)
-        plan.xBuf[k] = betan(x-(x0+k), plan.bspline);
-    for(int k = 0; k < kWidth; k++)
-        plan.yBuf[k] = betan(y-(y0+k), plan.bspline);
+    const int b = plan.border;
+
+    // Evaluate the kernel and the indices of the samples (in the image with
+    // its ghost border)
+    double* xW = malloc(nx*kWidth*sizeof*xW);
+    double* yW = malloc(ny*kWidth*sizeof*yW);
+    int* xI = malloc(nx*kWidth*sizeof*xI);
+    int* yI = malloc(ny*kWidth*sizeof*yI);
+    for(int i=0; i<nx; i++) {
+        double xs = x[i]+shift;
+        int x0 = ceil(xs-radius);
+        splinter_weights(xW+i*kWidth, xs, x0, &plan);
+        for(int k = 0; k < kWidth; k++) {
+            xI[i*kWidth+k] = (-b<=x0+k && x0+k<plan.w+b)?
+                x0+k+b: splinter_index(&plan, plan.w, x0+k)+b;
+        }
+    }
+    for(int j=0; j<ny; j++) {
+        double ys = y[j]+shift;
+        int y0 = ceil(ys-radius);
+        splinter_weights(yW+j*kWidth, ys, y0, &plan);
+        for(int l = 0; l < kWidth; l++) {
+            yI[j*kWidth+l] = (-b<=y0+l && y0+l<plan.h+b)?
+                y0+l+b: splinter_index(&plan, plan.h, y0+l)+b;
+        }
+    }
 
-    // Compute the interpolated value at (x,y)
-    for(int l=0; l<kWidth; l++) {
-        int iY = (shift2<=y0+l && y0+l<plan.h-shift2)?
-            y0+l: plan.ext(plan.h-2*shift, y0+l-shift)+shift;
-        int rowOffset = plan.w*iY;
+    // Rows of the prefiltered image which are used
+    int* row = malloc(plan.bh*sizeof*row);
+    int nRows = 0;
+    for(int r=0; r<plan.bh; r++)
+        row[r] = -1;
+    for(int k=0; k<ny*kWidth; k++)
+        if(row[yI[k]] < 0)
+            row[yI[k]] = nRows++;
+
+    // Interpolation of the rows at the abscissas
+    double* tmp = malloc(nRows*nx*sizeof*tmp);
+    for(int c=0; c<plan.c; c++) {
+        const coef_t* prefilt = plan.prefilt + c*plan.bw*plan.bh;
+        #pragma omp parallel for schedule(static)
+        for(int r=0; r<plan.bh; r++) {
+            if(row[r] < 0)
+                continue;
+            const coef_t* in = prefilt + r*plan.bw;
+            double* t = tmp + row[r]*nx;
+            for(int i=0; i<nx; i++) {
+                double s=0;
+                for(int k=0; k<kWidth; k++)
+                    s += in[xI[i*kWidth+k]]*xW[i*kWidth+k];
+                t[i] = s;
+            }
+        }
 
-        for(int c=0; c<plan.c; c++) {
-            double s=0;
-            for(int k=0; k<kWidth; k++) {
-                int iX = (shift2<=x0+k && x0+k<plan.w-shift2)?
-                    x0+k: plan.ext(plan.w-2*shift, x0+k-shift)+shift;
-                s += plan.prefilt[iX+rowOffset]*plan.xBuf[k];
+        // Interpolation of the columns at the ordinates
+        #pragma omp parallel for schedule(static)
+        for(int j=0; j<ny; j++) {
+            double* o = out + j*nx + c*nx*ny;
+            for(int i=0; i<nx; i++)
+                o[i] = 0;
+            for(int l=0; l<kWidth; l++) {
+                const double* t = tmp + row[yI[j*kWidth+l]]*nx;
+                double wy = yW[j*kWidth+l];
+                for(int i=0; i<nx; i++)
+                    o[i] += t[i]*wy;
             }
-            out[c] += s*plan.yBuf[l];
-            rowOffset += plan.w*plan.h;
         }
     }
+
+    free(xW);
+    free(yW);
+    free(xI);
+    free(yI);
+    free(row);
+    free(tmp);
 }
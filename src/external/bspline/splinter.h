@@ -40,12 +40,17 @@ typedef enum {
 /// (x,y), can then be performed.
 /// At the end, disposal is achieved by \ref splinter_destroy_plan.
 typedef struct {
-    double* prefilt; ///< prefiltered image
+    coef_t* prefilt; ///< prefiltered image, with a ghost border
     int w,h,c; ///< width,height,channels
+    int border; ///< width of the ghost border of the prefiltered image
+    int bw,bh; ///< dimensions of the prefiltered image with its border
     int shift; ///< shift in each channel
     Bspline* bspline; ///< Bspline kernel
     int (*ext)(int, int); ///< get pixels of extended image
     double *xBuf, *yBuf; ///< buffers for computation (internal usage)
+    double* taps; ///< polynomials of the kernel taps (NULL for order 0)
+    void (*dot)(double*, const coef_t*, int, int, int, int,
+                const double*, const double*); ///< evaluation kernel
 } splinter_plan_t;
 
 splinter_plan_t splinter_plan(const double* in, int w, int h, int c,
@@ -53,5 +58,10 @@ splinter_plan_t splinter_plan(const double* in, int w, int h, int c,
 void splinter_destroy_plan(splinter_plan_t plan);
 
 void splinter(double* out, double x, double y, splinter_plan_t plan);
+int splinter_kernel_width(const splinter_plan_t* plan);
+void splinter_r(double* out, double x, double y, const splinter_plan_t* plan,
+                double* xBuf, double* yBuf);
+void splinter_grid(double* out, const double* x, int nx, const double* y,
+                   int ny, splinter_plan_t plan);
 
 #endif
@@ -18,12 +18,12 @@
 
 static uint64_t lcg_knuth_seed = 0;
 
-static void lcg_knuth_srand(uint32_t x)
+static inline void lcg_knuth_srand(uint32_t x)
 {
     lcg_knuth_seed = x;
 }
 
-static uint32_t lcg_knuth_rand(void)
+static inline uint32_t lcg_knuth_rand(void)
 {
     lcg_knuth_seed *= 6364136223846793005;
     lcg_knuth_seed += 1442695040888963407;
@@ -31,28 +31,28 @@ static uint32_t lcg_knuth_rand(void)
 }
 
 
-static void xsrand(unsigned int seed)
+static inline void xsrand(unsigned int seed)
 {
     lcg_knuth_srand(seed);
 }
 
-static int xrand(void)
+static inline int xrand(void)
 {
     return lcg_knuth_rand();
 }
 
 // warning: the low bits will be set to zero (!) when converting to float
-static double random_raw(void)
+static inline double random_raw(void)
 {
     return xrand();
 }
 
-static double random_uniform(void)
+static inline double random_uniform(void)
 {
     return lcg_knuth_rand()/(0.0+UINT_MAX);
 }
 
-static double random_ramp(void)
+static inline double random_ramp(void)
 {
     double x1 = random_uniform();
     double x2 = random_uniform();
@@ -65,7 +65,7 @@ static double random_ramp(void)
 #define M_PI 3.14159265358979323846264338328
 #endif
 
-static double random_normal(void)
+static inline double random_normal(void)
 {
     double x1 = random_uniform();
     double x2 = random_uniform();
@@ -74,7 +74,7 @@ static double random_normal(void)
     return y;
 }
 
-static int randombounds(int a, int b)
+static inline int randombounds(int a, int b)
 {
     if (b < a)
             return randombounds(b, a);
@@ -83,7 +83,7 @@ static int randombounds(int a, int b)
     return a + lcg_knuth_rand() % (b - a + 1);
 }
 
-static double random_laplace(void)
+static inline double random_laplace(void)
 {
     double x = random_uniform();
     double y = random_uniform();
@@ -91,7 +91,7 @@ static double random_laplace(void)
     return isfinite(r)?r:0;
 }
 
-static double random_cauchy(void)
+static inline double random_cauchy(void)
 {
     double x1 = random_uniform();
     double x2 = random_uniform();
@@ -101,7 +101,7 @@ static double random_cauchy(void)
     return isfinite(r)?r:0;
 }
 
-static double random_exponential(void)
+static inline double random_exponential(void)
 {
     //double u = random_uniform();
     //double r = -log(1-u);
@@ -109,7 +109,7 @@ static double random_exponential(void)
     return fabs(random_laplace());
 }
 
-static double random_pareto(void)
+static inline double random_pareto(void)
 {
     return exp(random_exponential());
 }
@@ -124,7 +124,7 @@ static double random_pareto(void)
 //
 // Observation: the algorithm is numerically imprecise when alpha approaches 1.
 // TODO: implement appropriate rearrangements as suggested in the article.
-static double random_stable(double alpha, double beta)
+static inline double random_stable(double alpha, double beta)
 {
     double U = (random_uniform() - 0.5) * M_PI;
     double W = random_exponential();
@@ -24,218 +24,399 @@
 #include <complex.h>
 #include <fftw3.h>
 
+#include "fft_core.h"
+
 #define FFTW_NTHREADS // comment to disable multithreaded FFT
 
+// Environment variables used when no planning level or wisdom file is given
+#define FFTW_PLANNING_ENV "FFTW_PLANNING"
+#define FFTW_WISDOM_ENV "FFTW_WISDOM_FILE"
+
+// Directions of the transforms
+typedef enum {
+    FFT_R2C,
+    FFT_C2R,
+    FFT_C2C_FORWARD, // in-place transforms of the ny complex rows of length nx
+    FFT_C2C_BACKWARD,
+} FFTDirection;
+
+// Entry of the plan cache
+// The plans transform the nz channels of a planar image at once and they
+// are created for aligned arrays unless unaligned is set
+// The number of threads of a plan is the one available to the calling thread
+typedef struct {
+    int nx, ny, nz;
+    FFTDirection direction;
+    int unaligned;
+    int nthreads;
+    FFTW(plan) plan;
+} fft_plan_entry;
+
+// Process-wide plan cache (plans are created once for each size and direction)
+static fft_plan_entry *plan_cache = NULL;
+static int plan_cache_size = 0;
+static int plan_cache_capacity = 0;
+
+// Planning level and wisdom file
+static unsigned fftw_planning = FFTW_ESTIMATE;
+static int fftw_planning_set = 0;
+static char *fftw_wisdom_file = NULL;
+
+// Select the planning level between estimate, measure, patient and exhaustive
+// Return 0 if the level is unknown
+int set_fftw_planning(const char *level)
+{
+    if ( strcmp(level, "estimate") == 0 )
+        fftw_planning = FFTW_ESTIMATE;
+    else if ( strcmp(level, "measure") == 0 )
+        fftw_planning = FFTW_MEASURE;
+    else if ( strcmp(level, "patient") == 0 )
+        fftw_planning = FFTW_PATIENT;
+    else if ( strcmp(level, "exhaustive") == 0 )
+        fftw_planning = FFTW_EXHAUSTIVE;
+    else {
+        fprintf(stderr, "Unknown FFTW planning level %s (using estimate)\n", level);
+        fftw_planning = FFTW_ESTIMATE;
+        return 0;
+    }
+    fftw_planning_set = 1;
+    return 1;
+}
+
+// Set the file from which the wisdom is imported by init_fftw
+// and to which it is exported by clean_fftw
+void set_fftw_wisdom(const char *filename)
+{
+    free(fftw_wisdom_file);
+    fftw_wisdom_file = NULL;
+    if ( filename ) {
+        fftw_wisdom_file = malloc(strlen(filename)+1);
+        strcpy(fftw_wisdom_file, filename);
+    }
+}
+
 // Start threaded FFTW if FFTW_NTHREADS is defined
+// The planning level and the wisdom file are read from the environment
+// variables FFTW_PLANNING and FFTW_WISDOM_FILE unless they have been set before
 void init_fftw(void) {
     #ifdef FFTW_NTHREADS
-    fftw_init_threads();
+    FFTW(init_threads)();
     #ifdef _OPENMP
-    fftw_plan_with_nthreads(omp_get_max_threads());
+    FFTW(plan_with_nthreads)(omp_get_max_threads());
     #endif
     #endif
+
+    // planning options
+    const char *env;
+    if ( !fftw_planning_set && (env = getenv(FFTW_PLANNING_ENV)) )
+        set_fftw_planning(env);
+    if ( !fftw_wisdom_file && (env = getenv(FFTW_WISDOM_ENV)) && *env )
+        set_fftw_wisdom(env);
+
+    // import wisdom (the file may not exist yet)
+    if ( fftw_wisdom_file )
+        FFTW(import_wisdom_from_filename)(fftw_wisdom_file);
 }
 
 // Clean FFTW
+// The cached plans are destroyed and the wisdom is exported if a file is set
 void clean_fftw(void) {
-    fftw_cleanup();
+    if ( fftw_wisdom_file ) {
+        if ( !FFTW(export_wisdom_to_filename)(fftw_wisdom_file) )
+            fprintf(stderr, "Could not write FFTW wisdom to %s\n", fftw_wisdom_file);
+        set_fftw_wisdom(NULL);
+    }
+
+    for (int n = 0; n < plan_cache_size; n++)
+        FFTW(destroy_plan)(plan_cache[n].plan);
+    free(plan_cache);
+    plan_cache = NULL;
+    plan_cache_size = plan_cache_capacity = 0;
+
+    FFTW(cleanup)();
     #ifdef FFTW_NTHREADS
-    fftw_cleanup_threads(); 
+    FFTW(cleanup_threads)(); 
     #endif
 }
 
-// Compute the DFT of a real-valued image
-void do_fft_real(fftw_complex *out, const double *in, int nx, int ny, int nz)
+// Get the plan of the real transforms of the nz channels of size nx x ny from the cache
+// (or of the complex transforms of the rows for FFT_C2C_FORWARD and FFT_C2C_BACKWARD)
+// The plan is created if needed on temporary arrays so it must be executed
+// with the new-array execute functions. Aligned plans require arrays with the
+// same SIMD alignment as the ones given by fftw_malloc.
+static FFTW(plan) get_plan(int nx, int ny, int nz, FFTDirection direction, int unaligned)
 {
-    // memory allocation
-    fftw_complex *in_plan = (fftw_complex *) malloc(nx*ny*sizeof(fftw_complex));
-    fftw_complex *out_plan = (fftw_complex *) malloc(nx*ny*sizeof(fftw_complex));
-    fftw_plan plan = fftw_plan_dft_2d(ny, nx, in_plan, out_plan, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // loop over the channels
-    for (int l = 0; l < nz; l++) {
-        // Real --> complex
-        for(int i = 0; i < nx*ny; i++)
-            in_plan[i] = (double complex) in[i + l*nx*ny];
-
-        // compute fft
-        fftw_execute(plan);
-
-        // copy to output
-        memcpy(out + l*nx*ny, out_plan, nx*ny*sizeof(fftw_complex));
+    FFTW(plan) plan = NULL;
+
+    // threads available to the calling thread (a single one inside a parallel
+    // region which cannot be nested)
+    int nthreads = 1;
+    #if defined(FFTW_NTHREADS) && defined(_OPENMP)
+    if ( omp_get_active_level() < omp_get_max_active_levels() )
+        nthreads = omp_get_max_threads();
+    #endif
+
+    // the planner is not thread-safe
+    #ifdef _OPENMP
+    #pragma omp critical (fftw_planner)
+    #endif
+    {
+        for (int n = 0; n < plan_cache_size && !plan; n++)
+            if ( plan_cache[n].nx == nx && plan_cache[n].ny == ny && plan_cache[n].nz == nz
+                 && plan_cache[n].direction == direction && plan_cache[n].unaligned == unaligned
+                 && plan_cache[n].nthreads == nthreads )
+                plan = plan_cache[n].plan;
+
+        if ( !plan ) {
+            // planar layout: the channels are contiguous arrays of size
+            // nx x ny (real) and (nx/2+1) x ny (complex)
+            int n[2] = {ny, nx};
+            int rdist = nx*ny;
+            int cdist = (nx/2+1)*ny;
+            unsigned flags = fftw_planning | (unaligned ? FFTW_UNALIGNED : 0);
+            #ifdef FFTW_NTHREADS
+            FFTW(plan_with_nthreads)(nthreads);
+            #endif
+
+            // the arrays may be overwritten by the planner
+            if ( direction == FFT_C2C_FORWARD || direction == FFT_C2C_BACKWARD ) {
+                int sign = (direction == FFT_C2C_FORWARD) ? FFTW_FORWARD : FFTW_BACKWARD;
+                fft_complex *c = FFTW(malloc)(nx*ny*sizeof*c);
+                plan = FFTW(plan_many_dft)(1, &nx, ny, c, NULL, 1, nx,
+                                           c, NULL, 1, nx, sign, flags);
+                FFTW(free)(c);
+            }
+            else {
+                fft_real *r = FFTW(malloc)(rdist*nz*sizeof*r);
+                fft_complex *c = FFTW(malloc)(cdist*nz*sizeof*c);
+                if ( direction == FFT_R2C )
+                    plan = FFTW(plan_many_dft_r2c)(2, n, nz, r, NULL, 1, rdist,
+                                                   c, NULL, 1, cdist, flags);
+                else
+                    plan = FFTW(plan_many_dft_c2r)(2, n, nz, c, NULL, 1, cdist,
+                                                   r, NULL, 1, rdist, flags);
+                FFTW(free)(r);
+                FFTW(free)(c);
+            }
+
+            // add to the cache
+            if ( plan_cache_size == plan_cache_capacity ) {
+                plan_cache_capacity = plan_cache_capacity ? 2*plan_cache_capacity : 8;
+                plan_cache = realloc(plan_cache, plan_cache_capacity*sizeof*plan_cache);
+            }
+            plan_cache[plan_cache_size++] = (fft_plan_entry) {nx, ny, nz, direction, unaligned, nthreads, plan};
+        }
     }
 
-    // free
-    fftw_destroy_plan(plan);
-    fftw_free(in_plan);
-    fftw_free(out_plan);
+    return plan;
 }
 
-// Compute the real part of the iDFT of a complex-valued image
-void do_ifft_real(double *out, const fftw_complex *in, int nx, int ny, int nz)
+// Compute the DFT of a real-valued image
+// Only the Hermitian half of the spectrum is stored: for each channel
+// the output is a (nx/2+1) x ny array
+// All the channels are transformed at once directly from in to out
+// (in single precision the input is first converted)
+void do_fft_real(fft_complex *out, const double *in, int nx, int ny, int nz)
 {
-    // memory allocation
-    fftw_complex *in_plan = (fftw_complex *) malloc(nx*ny*sizeof(fftw_complex));
-    fftw_complex *out_plan = (fftw_complex *) malloc(nx*ny*sizeof(fftw_complex));
-    fftw_plan plan = fftw_plan_dft_2d (ny, nx, in_plan, out_plan, FFTW_BACKWARD, FFTW_ESTIMATE);
+#ifdef SINGLE_PRECISION
+    fft_real *r = FFTW(malloc)(nx*ny*nz*sizeof*r);
+    for(int i = 0; i < nx*ny*nz; i++)
+        r[i] = in[i];
+#else
+    fft_real *r = (double *) in;
+#endif
 
-    // normalization constant
-    double norm = 1.0/(nx*ny);
+    // arrays which are not allocated by fftw_malloc need an unaligned plan
+    int unaligned = FFTW(alignment_of)(r) || FFTW(alignment_of)((fft_real *) out);
+    FFTW(plan) plan = get_plan(nx, ny, nz, FFT_R2C, unaligned);
 
-    // loop over the channels
-    for (int l = 0; l < nz; l++) {
-        // copy to input
-        memcpy(in_plan, in + l*nx*ny, nx*ny*sizeof(fftw_complex));
+    // compute fft (an out-of-place r2c transform preserves its input)
+    FFTW(execute_dft_r2c)(plan, r, out);
 
-        // compute ifft
-        fftw_execute(plan);
+#ifdef SINGLE_PRECISION
+    FFTW(free)(r);
+#endif
+}
 
-        // complex to real + normalization
-        for(int i = 0; i < nx*ny; i++)
-            out[i + l*nx*ny] = creal(out_plan[i])*norm;
-    }
+// Compute the iDFT of a Hermitian half spectrum (real-valued image)
+// For each channel the input is a (nx/2+1) x ny array
+// All the channels are transformed at once and the input is destroyed
+// (in single precision the output is converted with the normalization)
+void do_ifft_real(double *out, fft_complex *in, int nx, int ny, int nz)
+{
+#ifdef SINGLE_PRECISION
+    fft_real *r = FFTW(malloc)(nx*ny*nz*sizeof*r);
+#else
+    fft_real *r = out;
+#endif
+
+    // arrays which are not allocated by fftw_malloc need an unaligned plan
+    int unaligned = FFTW(alignment_of)((fft_real *) in) || FFTW(alignment_of)(r);
+    FFTW(plan) plan = get_plan(nx, ny, nz, FFT_C2R, unaligned);
 
-    // free
-    fftw_destroy_plan(plan);
-    fftw_free(in_plan);
-    fftw_free(out_plan);
+    // compute ifft
+    FFTW(execute_dft_c2r)(plan, in, r);
+
+    // normalization
+    double norm = 1.0/(nx*ny);
+#ifdef SINGLE_PRECISION
+    for(int i = 0; i < nx*ny*nz; i++)
+        out[i] = r[i]*norm;
+    FFTW(free)(r);
+#else
+    for(int i = 0; i < nx*ny*nz; i++)
+        out[i] *= norm;
+#endif
 }
 
-// Compute the fftshift of a complex-valued image
-void fftshift(fftw_complex *fshift, fftw_complex *fhat, int nx, int ny, int nz) {
-    int nx2 = nx/2;
-    int ny2 = ny/2;
-    int cx = (nx+1)/2;
-    int cy = (ny+1)/2;
-    int i, j, l, i2, j2;
-
-    for(j = 0; j < ny; j++) {
-        j2 = (j < cy) ? j + ny2 : j - cy;
-        for(i = 0; i < nx; i++) {
-            i2 = (i < cx) ? i + nx2 : i - cx;
-            for(l = 0; l < nz; l++)
-                fshift[i2 + j2*nx + l*nx*ny] = fhat[i + j*nx + l*nx*ny];
-        }
-    }
+// Compute in place the DFT (sign FFTW_FORWARD) or the iDFT without normalization
+// (sign FFTW_BACKWARD) of the ny rows of length nx of a complex array
+void do_dft_rows(fft_complex *data, int nx, int ny, int sign)
+{
+    int unaligned = FFTW(alignment_of)((fft_real *) data);
+    FFTDirection direction = (sign == FFTW_FORWARD) ? FFT_C2C_FORWARD : FFT_C2C_BACKWARD;
+    FFTW(plan) plan = get_plan(nx, ny, 1, direction, unaligned);
+    FFTW(execute_dft)(plan, data, data);
 }
 
-// Compute the DFT coefficients of the up-sampled image
+// Get the DFT coefficient (i,j) of a real-valued image from its half spectrum
+fft_complex hermitian_coefficient(const fft_complex *fhat, int i, int j, int nx, int ny)
+{
+    int nxh = nx/2+1;
+    if ( i < nxh )
+        return fhat[i + j*nxh];
+    return conj(fhat[(nx-i) + ((ny-j)%ny)*nxh]);
+}
+
+// Compute the DFT coefficients (half spectrum) of the up-sampled image
 // See https://www.ipol.im/pub/art/2019/273/ (Line 3 of Algorithm 3 using Proposition 11)
-void upsampling_fourier(fftw_complex *out, fftw_complex *in,
+// Only the non-negative horizontal frequencies are stored so that the
+// negative ones are implicitly given by Hermitian symmetry
+// The computation can be done in place (out = in, with the size of the output)
+void upsampling_fourier(fft_complex *out, fft_complex *in,
                                int nxin, int nyin, int nxout, int nyout, int nz, int interp)
 {
-    int i, j, l, i2, j2;
+    int i, j, l, j2;
+    
+    // sizes of the half spectra
+    int nxhin = nxin/2+1;
+    int nxhout = nxout/2+1;
     
     // normalization constant
     double norm = nxout*nyout*1.0/(nxin*nyin);
     
     // indices for the fftshift
-    int nx2 = (nxin+1)/2; 
+    int nx2 = nxin/2;
     int ny2 = (nyin+1)/2;
 
-    // fill the output dft with zeros
-    for (i = 0; i < nxout*nyout*nz; i++)
-        out[i] = 0.0;
-
-    // fill the corners with the values
-    for(j = 0; j < nyin; j++) {
-        j2 = (j < ny2) ? j : j + nyout-nyin;
-        for(i = 0; i < nxin; i++) {
-            i2 = (i < nx2) ? i : i + nxout-nxin;
-            for (l = 0; l < nz; l++)
-                out[i2 + j2*nxout + l*nxout*nyout] = norm*in[i + j*nxin + l*nxin*nyin];
-        }
+    // Nyquist coefficients of the input (overwritten when done in place)
+    fft_complex *hf = NULL;
+    if ( !(nxin%2) && !(nyin%2) && nxout>nxin && nyout>nyin ) {
+        hf = malloc(nz*sizeof*hf);
+        for (l = 0; l < nz; l++)
+            hf[l] = norm*in[nx2 + ny2*nxhin + l*nxhin*nyin];
     }
 
+    // fill the corners with the values and the rest of the output dft with zeros
+    // (the output rows are filled from the last one: the location of a value
+    // in the output is after its location in the input)
+    for (l = nz-1; l >= 0; l--)
+        for (j2 = nyout-1; j2 >= 0; j2--) {
+            fft_complex *row = out + j2*nxhout + l*nxhout*nyout;
+            i = 0;
+            if ( j2 < ny2 || j2 >= ny2 + nyout-nyin ) {
+                j = (j2 < ny2) ? j2 : j2 - (nyout-nyin);
+                memmove(row, in + j*nxhin + l*nxhin*nyin, nxhin*sizeof*row);
+                for (; i < nxhin; i++)
+                    row[i] *= norm;
+            }
+            for (; i < nxhout; i++)
+                row[i] = 0.0;
+        }
+
     // real part
-        // useless in practice if the real part of the image is taken afterwards
+        // the Nyquist coefficients are split between the positive and
+        // negative frequencies (only the positive one is stored horizontally)
         if ( !(nxin%2) && nxout>nxin) {
-            i = nx2; // positive in output and negative in input
-            i2 = nx2 + nxout-nxin; // negative in output (already initialized)
-            for(j = 0; j < nyin; j++) {
-                j2 = (j < ny2) ? j : j + nyout-nyin;
-                for (l = 0; l < nz; l++) {
-                    out[i2 + j2*nxout + l*nxout*nyout] *= 0.5;
-                    out[i + j2*nxout + l*nxout*nyout] = out[i2 + j2*nxout + l*nxout*nyout];
-                }
-            }
+            i = nx2;
+            for(j = 0; j < nyout; j++)
+                for (l = 0; l < nz; l++)
+                    out[i + j*nxhout + l*nxhout*nyout] *= 0.5;
         }
 
         if ( !(nyin%2) && nyout>nyin) {
             j = ny2; // positive in output and negative in input
             j2 = ny2 + nyout-nyin; // negative in output (already initialized)
-            for(i = 0; i < nxin; i++) {
-                i2 = (i < nx2) ? i : i + nxout-nxin;
+            for(i = 0; i < nxhin; i++)
                 for (l = 0; l < nz; l++) {
-                    out[i2 + j2*nxout + l*nxout*nyout] *= 0.5;
-                    out[i2 + j*nxout + l*nxout*nyout] = out[i2 + j2*nxout + l*nxout*nyout];
+                    out[i + j2*nxhout + l*nxhout*nyout] *= 0.5;
+                    out[i + j*nxhout + l*nxhout*nyout] = out[i + j2*nxhout + l*nxhout*nyout];
                 }
-            }
         }
         
+        // the complex convention is not Hermitian: the real part of its iDFT
+        // is the iDFT of its Hermitian part, which is stored here
         if ( !interp && !(nxin%2) && !(nyin%2) && nxout>nxin && nyout>nyin) {
             i = nx2; // positive in output and negative in input
-            i2 = nx2 + nxout-nxin; // negative in output
             j = ny2; // positive in output and negative in input
             j2 = ny2 + nyout-nyin; // negative in output
             for (l = 0; l < nz; l++) {
-                double complex hf = norm*0.5*in[i + j*nxin + l*nxin*nyin];
-                out[i + j*nxout + l*nxout*nyout] = out[i2 + j2*nxout + l*nxout*nyout] = hf;
+                out[i + j*nxhout + l*nxhout*nyout] = 0.5*hf[l];
+                out[i + j2*nxhout + l*nxhout*nyout] = 0.375*hf[l];
             }
         }
         
     // real convention
     if ( interp && !(nxin%2) && !(nyin%2) && nxout>nxin && nyout>nyin) {
         i = nx2; // positive in output and negative in input
-        i2 = nx2 + nxout-nxin; // negative in output
         j = ny2; // positive in output and negative in input
         j2 = ny2 + nyout-nyin; // negative in output
-        for (l = 0; l < nz; l++) {
-            double complex hf = norm*0.25*in[i + j*nxin + l*nxin*nyin];
-            out[i + j*nxout + l*nxout*nyout] = out[i2 + j*nxout + l*nxout*nyout] = out[i + j2*nxout + l*nxout*nyout] = out[i2 + j2*nxout + l*nxout*nyout] = hf;
-        }
+        for (l = 0; l < nz; l++)
+            out[i + j*nxhout + l*nxhout*nyout] = out[i + j2*nxhout + l*nxhout*nyout] = 0.25*hf[l];
     }
+
+    free(hf);
 }
 
 // Up-sampling of an image using TPI
 // See https://www.ipol.im/pub/art/2019/273/ (Algorithm 3)
 void upsampling(double *out, double *in, int nxin, int nyin, int nxout, int nyout, int nz, int interp) 
 {
-    // allocate memory for fourier transform
-    fftw_complex *inhat = fftw_malloc(nxin*nyin*nz*sizeof*inhat);
-    fftw_complex *outhat = fftw_malloc(nxout*nyout*nz*sizeof*outhat);
+    // allocate memory for fourier transform (half spectrum of the output)
+    fft_complex *outhat = FFTW(malloc)((nxout/2+1)*nyout*nz*sizeof*outhat);
 
-    // compute DFT of the input
-    do_fft_real(inhat, in, nxin, nyin, nz);
+    // compute DFT of the input (at the beginning of the output spectrum)
+    do_fft_real(outhat, in, nxin, nyin, nz);
 
-    // phase shift (complex convention)
-    upsampling_fourier(outhat, inhat, nxin, nyin, nxout, nyout, nz, interp);
+    // phase shift (complex convention) in place
+    upsampling_fourier(outhat, outhat, nxin, nyin, nxout, nyout, nz, interp);
 
     // compute iDFT of the output
     do_ifft_real(out, outhat, nxout, nyout, nz);
 
     // free memory
-    fftw_free(inhat);
-    fftw_free(outhat);
+    FFTW(free)(outhat);
 }
 
 // Spectrum clipping of an image in the Fourier domain (Equation 8)
-static void spectrum_clipping_fourier(fftw_complex *outhat, fftw_complex *inhat, int nx, int ny, int nz, double r)
+// The spectra are half spectra (non-negative horizontal frequencies)
+static void spectrum_clipping_fourier(fft_complex *outhat, fft_complex *inhat, int nx, int ny, int nz, double r)
 {
+    // size of the half spectrum
+    int nxh = nx/2+1;
+    
     // indices for the fftshift
-    int nx2 = (nx+1)/2; 
     int ny2 = (ny+1)/2;
     
-    int i2, j2, factori, factorj;
+    int j2, factori, factorj;
     
     for(int j = 0; j < ny; j++) {
         j2 = (j < ny2) ? j : j - ny;
         factorj = ( 2*fabs(j2) > (1 - r)*ny ) ? 0 : 1;
-        for(int i = 0; i < nx; i++) {
-            i2 = (i < nx2) ? i : i - nx;
-            factori = ( 2*fabs(i2) > (1 - r)*nx ) ? 0 : 1;
+        for(int i = 0; i < nxh; i++) {
+            factori = ( 2*i > (1 - r)*nx ) ? 0 : 1;
             for(int l = 0; l < nz; l++)
-                outhat[i+j*nx+l*nx*ny] = factori*factorj*inhat[i+j*nx+l*nx*ny];
+                outhat[i+j*nxh+l*nxh*ny] = factori*factorj*inhat[i+j*nxh+l*nxh*ny];
         }
     }
 }
@@ -243,8 +424,8 @@ static void spectrum_clipping_fourier(fftw_complex *outhat, fftw_complex *inhat,
 // Spectrum clipping of an image (Definition 6)
 void spectrum_clipping(double *out, double *in, int nx, int ny, int nz, double r)
 {
-    // allocate memory for fourier transform
-    fftw_complex *inhat = fftw_malloc(nx*ny*nz*sizeof*inhat);
+    // allocate memory for fourier transform (half spectrum)
+    fft_complex *inhat = FFTW(malloc)((nx/2+1)*ny*nz*sizeof*inhat);
     
     // compute DFT of the input
     do_fft_real(inhat, in, nx, ny, nz);
@@ -256,5 +437,5 @@ void spectrum_clipping(double *out, double *in, int nx, int ny, int nz, double r
     do_ifft_real(out, inhat, nx, ny, nz);
     
     // free memory
-    fftw_free(inhat);
+    FFTW(free)(inhat);
 }
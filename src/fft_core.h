@@ -20,18 +20,35 @@
 #include <complex.h>
 #include <fftw3.h>
 
-// Start threaded FFTW if FFTW_NTHREADS is defined
+// Precision of the Fourier computations (the images are in double precision)
+#ifdef SINGLE_PRECISION
+typedef float fft_real;
+typedef fftwf_complex fft_complex;
+#define FFTW(name) fftwf_##name
+#else
+typedef double fft_real;
+typedef fftw_complex fft_complex;
+#define FFTW(name) fftw_##name
+#endif
+
+// Select the FFTW planning level (estimate, measure, patient or exhaustive)
+int set_fftw_planning(const char *level);
+// Set the FFTW wisdom file (imported by init_fftw and exported by clean_fftw)
+void set_fftw_wisdom(const char *filename);
+// Start threaded FFTW if FFTW_NTHREADS is defined and import the wisdom
 void init_fftw(void);
-// Clean FFTW
+// Clean FFTW, the plan cache and export the wisdom
 void clean_fftw(void);
-// Compute the DFT of a real-valued image
-void do_fft_real(fftw_complex *out, const double *in, int nx, int ny, int nz);
-// Compute the real part of the iDFT of a complex-valued image
-void do_ifft_real(double *out, const fftw_complex *in, int nx, int ny, int nz);
-// Compute the fftshift of a complex-valued image
-void fftshift(fftw_complex *fshift, fftw_complex *fhat, int nx, int ny, int nz);
-// Compute the DFT coefficients of the up-sampled image
-void upsampling_fourier(fftw_complex *out, fftw_complex *in,
+// Compute the DFT of a real-valued image (half spectrum of size (nx/2+1) x ny)
+void do_fft_real(fft_complex *out, const double *in, int nx, int ny, int nz);
+// Compute the iDFT of a Hermitian half spectrum (real-valued image, the input is destroyed)
+void do_ifft_real(double *out, fft_complex *in, int nx, int ny, int nz);
+// Compute in place the DFT or the iDFT (without normalization) of the rows of a complex array
+void do_dft_rows(fft_complex *data, int nx, int ny, int sign);
+// Get the DFT coefficient (i,j) of a real-valued image from its half spectrum
+fft_complex hermitian_coefficient(const fft_complex *fhat, int i, int j, int nx, int ny);
+// Compute the DFT coefficients (half spectrum) of the up-sampled image
+void upsampling_fourier(fft_complex *out, fft_complex *in,
                         int nxin, int nyin, int nxout, int nyout, int nz, int interp);
 // Up-sampling of an image using TPI
 void upsampling(double *out, double *in, int nxin, int nyin, int nxout, int nyout, int nz, int interp);
@@ -14,6 +14,9 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
+
+#include "homography_core.h"
 #include "random.h"
 #include "cmphomod.h"
 
@@ -51,6 +54,28 @@ void apply_homography(double y[2], const double x[2], const double H[9])
   y[1] = z[1]/z[2];
 }
 
+// Classify an homography (by increasing generality)
+// The coefficients are compared up to a relative tolerance
+TransformType classify_homography(const double H[9])
+{
+  double eps = 1e-12*fabs(H[8]);
+
+  if ( fabs(H[6]) > eps || fabs(H[7]) > eps || H[8] == 0 )
+    return TRANSFORM_PROJECTIVE;
+  if ( fabs(H[1]) > eps || fabs(H[3]) > eps )
+    return TRANSFORM_AFFINE;
+  if ( fabs(H[0] - H[8]) > eps || fabs(H[4] - H[8]) > eps )
+    return TRANSFORM_SCALING;
+
+  double tx = H[2]/H[8];
+  double ty = H[5]/H[8];
+  if ( fabs(tx - round(tx)) > 1e-12 || fabs(ty - round(ty)) > 1e-12 )
+    return TRANSFORM_TRANSLATION;
+  if ( round(tx) != 0 || round(ty) != 0 )
+    return TRANSFORM_INTEGER_TRANSLATION;
+  return TRANSFORM_IDENTITY;
+}
+
 // translate homography in order to compute the result of a crop
 // h_in(x+tx,y+ty) = (tx,ty) + h_out(x,y)
 // i.e h_out = t(-tx,-ty) o h_in o t(tx,ty)
@@ -98,18 +123,17 @@ void create_random_translation(double H[9], double L)
         H[8] = 1.0;
 }
 
-// Draw a random homography (Algorithm 1)
-void create_random_homography(double H[9], int w, int h, double L)
+// Compute the homography given by the displacement of the four corners
+// (0,0), (w-1,0), (0,h-1) and (w-1,h-1) of an image
+// The displacements are given as d = {dx1, dy1, dx2, dy2, dx3, dy3, dx4, dy4}
+void homography_from_corners(double H[9], int w, int h, const double d[8])
 {
     double corner[4][2] = {{0,0}, {w-1,0}, {0,h-1}, {w-1,h-1}};
     double corner2[4][2];
-    double a;
     
-    for(int j = 0; j < 2; j++)
-        for(int i = 0; i < 4; i++) {
-            a = random_uniform();
-            corner2[i][j] = corner[i][j] + (2*L*a - L);
-        }
+    for(int i = 0; i < 4; i++)
+        for(int j = 0; j < 2; j++)
+            corner2[i][j] = corner[i][j] + d[2*i+j];
 
     double R[3][3];
     homography_from_4corresp(
@@ -120,6 +144,21 @@ void create_random_homography(double H[9], int w, int h, double L)
         H[i] = R[i/3][i%3];
 }
 
+// Draw a random homography (Algorithm 1)
+void create_random_homography(double H[9], int w, int h, double L)
+{
+    double d[8];
+    double a;
+    
+    for(int j = 0; j < 2; j++)
+        for(int i = 0; i < 4; i++) {
+            a = random_uniform();
+            d[2*i+j] = 2*L*a - L;
+        }
+
+    homography_from_corners(H, w, h, d);
+}
+
 // Draw a random homography of a given type
 // 2 --> translation
 // 3 --> euclidean
@@ -17,14 +17,29 @@
 #ifndef HOMOGRAPHY_H
 #define HOMOGRAPHY_H
 
+// Types of homographies (by increasing generality)
+typedef enum
+{
+    TRANSFORM_IDENTITY = 0,
+    TRANSFORM_INTEGER_TRANSLATION = 1,
+    TRANSFORM_TRANSLATION = 2,
+    TRANSFORM_SCALING = 3, // axis-aligned scaling and translation
+    TRANSFORM_AFFINE = 4,
+    TRANSFORM_PROJECTIVE = 5
+} TransformType;
+
 // Compute the inverse of an homography
 void invert_homography(double iH[9], const double H[9]);
 // Compute the image y of the vector x by the homography H
 void apply_homography(double y[2], const double x[2], const double H[9]);
+// Classify an homography (identity, translation, scaling, affine or projective)
+TransformType classify_homography(const double H[9]);
 // translate homography in order to compute the result of a crop
 void translate_homography(double *h_out, double *h_in, double tx, double ty);
 // zoom homography in order to be compatible with a zoom of an image
 void zoom_homography(double *h_out, double *h_in, double zx, double zy);
+// Compute the homography given by the displacement of the four corners of an image
+void homography_from_corners(double H[9], int w, int h, const double d[8]);
 // Draw a random translation
 void create_random_translation(double H[9], double L);
 // Draw a random homography
@@ -41,6 +41,33 @@ BoundaryExt read_ext(const char* boundary) {
     exit(EXIT_FAILURE);
 }
 
+// Memory budget in bytes (0 for no limit)
+static double max_memory = 0;
+
+// Set the memory budget of the interpolation from a size in megabytes
+// (optionally with a suffix K, M, G or T)
+int set_max_memory(const char *size)
+{
+    char *end;
+    double value = strtod(size, &end);
+    double unit = 1 << 20;
+    if ( *end == 'K' || *end == 'k' )
+        unit = 1 << 10;
+    else if ( *end == 'G' || *end == 'g' )
+        unit = 1 << 30;
+    else if ( *end == 'T' || *end == 't' )
+        unit = 1024.0*(1 << 30);
+    else if ( *end && *end != 'M' && *end != 'm' )
+        value = -1;
+    if ( end == size || value < 0 ) {
+        fprintf(stderr, "Invalid memory budget %s (no limit)\n", size);
+        max_memory = 0;
+        return 0;
+    }
+    max_memory = value*unit;
+    return 1;
+}
+
 // Compare end of string (useful for reading the interpolation method)
 static int EndsWith(const char *str, const char *suffix)
 {
@@ -53,50 +80,288 @@ static int EndsWith(const char *str, const char *suffix)
     return strncmp(str + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
-// Resampling of an image at given locations (x,y) using B-spline interpolation
-static void splinter_at(double *out, double *in, int w, int h, int pd, int n,
-                        BoundaryExt bc, double precision, int larger, double *x,
-                        double *y, int numPixels) {
-    // init plan (prefiltering)
-    splinter_plan_t plan = splinter_plan(in, w, h, pd, n, bc, precision, larger);
-    
-    // computation of the pixel locations
-    double *outp = malloc(pd*sizeof*outp);
-    for(int i = 0; i < numPixels; i++) {
-            splinter(outp, x[i], y[i], plan);
-            for(int k = 0; k < pd; k++)
-                out[k*numPixels] = outp[k];
-            ++out;
-    }
-    
-    free(outp);
-    splinter_destroy_plan(plan);
-}
-
-// Resampling of an image at given locations (x,y)
-// using a base interpolation method
-static void interpolate_at(double *out, double *in, int w, int h, int pd,
-                           char *interp, BoundaryExt bc, double *x,
-                           double *y, int numPixels) {
-    if (0 == strncmp(interp, "bic", 3))
-        interpolate_bicubic(out, in, w, h, pd, bc, x, y, numPixels);
-    else if (0 == strncmp(interp, "tpi", 3))
-        interpolate_at_locations_nfft(out, in, w, h, pd, x, y, numPixels, 1);
-    else if (0 == strncmp(interp, "spline", 6)) {
-        // order
-        int order = -1;
-        sscanf(interp, "spline%d", &order);
+// Types of grids of locations
+typedef enum {
+    GRID_EXPLICIT = 0,   // arrays of locations (x,y)
+    GRID_SEPARABLE = 1,  // tensor grid xs x ys
+    GRID_HOMOGRAPHY = 2  // locations iH(zoom*i, zoom*j) generated row by row
+} GridType;
+
+// Locations at which an image is resampled
+// For separable and homography grids the locations are organized as an
+// nx x ny output grid, and the full arrays of locations are never created
+// (except for TPI which needs all the nodes at once)
+typedef struct {
+    GridType type;
+    int numPixels;           // number of locations
+    double *x, *y;           // explicit locations
+    double *xs, *ys;         // abscissas and ordinates of a separable grid
+    int nx, ny;              // sizes of the output grid
+    double iH[9];            // inverse homography of a homography grid
+    TransformType transform; // type of iH
+    float zoom;              // step of the output grid
+    double scale;            // scaling of the generated locations
+} sampling_grid_t;
+
+// Number of explicit locations in a tile
+#define GRID_TILE 4096
+
+// Maximal number of locations in a tile (the tiles of the other grids are the rows)
+static int grid_tile_size(const sampling_grid_t *grid) {
+    if ( grid->type == GRID_EXPLICIT )
+        return grid->numPixels < GRID_TILE ? grid->numPixels : GRID_TILE;
+    return grid->nx;
+}
+
+// Number of tiles of a grid
+static int grid_num_tiles(const sampling_grid_t *grid) {
+    if ( grid->type == GRID_EXPLICIT )
+        return (grid->numPixels + GRID_TILE - 1)/GRID_TILE;
+    return grid->ny;
+}
+
+// Compute the locations of the tile t of a grid
+// Return the number of locations and the index of the first one in offset
+// For a homography the numerators and the denominator are updated incrementally
+// along the row (one reciprocal per pixel) and affine maps need no division
+static int grid_tile(const sampling_grid_t *grid, int t, double *x, double *y,
+                     int *offset) {
+    if ( grid->type == GRID_EXPLICIT ) {
+        *offset = t*GRID_TILE;
+        int n = grid->numPixels - *offset;
+        n = n < GRID_TILE ? n : GRID_TILE;
+        memcpy(x, grid->x + *offset, n*sizeof(double));
+        memcpy(y, grid->y + *offset, n*sizeof(double));
+        return n;
+    }
+    
+    int nx = grid->nx;
+    *offset = t*nx;
+    if ( grid->type == GRID_SEPARABLE ) {
+        memcpy(x, grid->xs, nx*sizeof(double));
+        for (int i = 0; i < nx; i++)
+            y[i] = grid->ys[t];
+        return nx;
+    }
+    
+    const double *iH = grid->iH;
+    float zoom = grid->zoom;
+    double scale = grid->scale;
+    if ( grid->transform <= TRANSFORM_AFFINE ) {
+        double a = iH[0]/iH[8], b = iH[1]/iH[8], c = iH[2]/iH[8];
+        double d = iH[3]/iH[8], e = iH[4]/iH[8], f = iH[5]/iH[8];
+        double bj = b*(t*zoom);
+        double ej = e*(t*zoom);
+        for (int i = 0; i < nx; i++) {
+            x[i] = scale*(a*(i*zoom) + bj + c);
+            y[i] = scale*(d*(i*zoom) + ej + f);
+        }
+    }
+    else {
+        double zx = iH[1]*(t*zoom) + iH[2];
+        double zy = iH[4]*(t*zoom) + iH[5];
+        double zw = iH[7]*(t*zoom) + iH[8];
+        double dx = iH[0]*zoom, dy = iH[3]*zoom, dw = iH[6]*zoom;
+        for (int i = 0; i < nx; i++) {
+            double r = 1.0/zw;
+            x[i] = scale*(zx*r);
+            y[i] = scale*(zy*r);
+            zx += dx;
+            zy += dy;
+            zw += dw;
+        }
+    }
+    return nx;
+}
+
+// Get the arrays of all the locations of a grid
+// Return 1 if the arrays have been allocated (and must be freed)
+static int grid_locations(const sampling_grid_t *grid, double **x, double **y) {
+    if ( grid->type == GRID_EXPLICIT ) {
+        *x = grid->x;
+        *y = grid->y;
+        return 0;
+    }
+    *x = malloc(grid->numPixels*sizeof(double));
+    *y = malloc(grid->numPixels*sizeof(double));
+    int offset;
+    for (int t = 0; t < grid_num_tiles(grid); t++)
+        grid_tile(grid, t, *x + t*grid->nx, *y + t*grid->nx, &offset);
+    return 1;
+}
+
+// Scale the locations of a grid
+static void scale_grid(sampling_grid_t *grid, double zoom) {
+    if ( grid->type == GRID_EXPLICIT )
+        for (int i = 0; i < grid->numPixels; i++) {
+            grid->x[i] *= zoom;
+            grid->y[i] *= zoom;
+        }
+    else if ( grid->type == GRID_SEPARABLE ) {
+        for (int i = 0; i < grid->nx; i++)
+            grid->xs[i] *= zoom;
+        for (int j = 0; j < grid->ny; j++)
+            grid->ys[j] *= zoom;
+    }
+    else
+        grid->scale *= zoom;
+}
+
+// Resampling of an image at given locations using B-spline interpolation
+// of several orders. All the orders are evaluated in one pass over the locations
+// (tile by tile). On a separable grid each order is evaluated by two 1D passes.
+static void splinter_at(double **out, double *in, int w, int h, int pd,
+                        const int *orders, int norders, BoundaryExt bc,
+                        double precision, int larger, const sampling_grid_t *grid) {
+    // init plans (prefiltering)
+    splinter_plan_t *plans = malloc(norders*sizeof*plans);
+    for(int n = 0; n < norders; n++)
+        plans[n] = splinter_plan(in, w, h, pd, orders[n], bc, precision, larger);
+    
+    if ( grid->type == GRID_SEPARABLE ) {
+        for(int n = 0; n < norders; n++)
+            splinter_grid(out[n], grid->xs, grid->nx, grid->ys, grid->ny, plans[n]);
+    }
+    else {
+        // computation of the pixel locations (the tiles are shared between
+        // the threads, each thread having its own buffers)
+        int numPixels = grid->numPixels;
+        int tsize = grid_tile_size(grid);
+        int ntiles = grid_num_tiles(grid);
+        int kwidth = 0;
+        for(int n = 0; n < norders; n++)
+            if ( splinter_kernel_width(plans + n) > kwidth )
+                kwidth = splinter_kernel_width(plans + n);
         
-        if ( order < 0 ) {
-            order = 0;
-            printf("Negative order in B-spline interpolation...");
-            printf(" Switching to order 0\n");
+        #pragma omp parallel
+        {
+            double *x = malloc(tsize*sizeof*x);
+            double *y = malloc(tsize*sizeof*y);
+            double *outp = malloc(pd*sizeof*outp);
+            double *xbuf = malloc(kwidth*sizeof*xbuf);
+            double *ybuf = malloc(kwidth*sizeof*ybuf);
+            
+            #pragma omp for schedule(dynamic)
+            for(int t = 0; t < ntiles; t++) {
+                int offset;
+                int npix = grid_tile(grid, t, x, y, &offset);
+                for(int i = 0; i < npix; i++)
+                    for(int n = 0; n < norders; n++) {
+                        splinter_r(outp, x[i], y[i], plans + n, xbuf, ybuf);
+                        for(int k = 0; k < pd; k++)
+                            out[n][offset + i + k*numPixels] = outp[k];
+                    }
+            }
+            
+            free(x);
+            free(y);
+            free(outp);
+            free(xbuf);
+            free(ybuf);
         }
-        else if ( order > 16 ) {
-            order = 16;
-            printf("Maximal order is 16...\n");
+    }
+    
+    for(int n = 0; n < norders; n++)
+        splinter_destroy_plan(plans[n]);
+    free(plans);
+}
+
+// Resampling of an image at given locations using bicubic interpolation
+// The locations are computed tile by tile (except on a separable grid)
+// and the tiles are interpolated in parallel
+static void bicubic_at(double *out, double *in, int w, int h, int pd,
+                       BoundaryExt bc, const sampling_grid_t *grid) {
+    if ( grid->type == GRID_SEPARABLE ) {
+        interpolate_bicubic_separable(out, in, w, h, pd, bc, grid->xs,
+                                      grid->nx, grid->ys, grid->ny);
+        return;
+    }
+    
+    int tsize = grid_tile_size(grid);
+    int ntiles = grid_num_tiles(grid);
+    
+    // the tiles are shared between the threads
+    #pragma omp parallel
+    {
+        double *x = malloc(tsize*sizeof*x);
+        double *y = malloc(tsize*sizeof*y);
+        
+        #pragma omp for schedule(dynamic)
+        for(int t = 0; t < ntiles; t++) {
+            int offset;
+            int npix = grid_tile(grid, t, x, y, &offset);
+            interpolate_bicubic(out + offset, in, w, h, pd, bc, x, y, npix,
+                                grid->numPixels);
         }
         
+        free(x);
+        free(y);
+    }
+}
+
+// Read the order of a B-spline interpolation method "splineN"
+static int read_spline_order(const char *interp) {
+    int order = -1;
+    sscanf(interp, "spline%d", &order);
+    
+    if ( order < 0 ) {
+        order = 0;
+        printf("Negative order in B-spline interpolation...");
+        printf(" Switching to order 0\n");
+    }
+    else if ( order > 16 ) {
+        order = 16;
+        printf("Maximal order is 16...\n");
+    }
+    
+    return order;
+}
+
+// Resampling of an image at given locations using TPI
+// Separable grids are done by 1D transforms and the other grids by a 2D NFFT
+static void tpi_at(double *out, double *in, int w, int h, int pd,
+                   const sampling_grid_t *grid) {
+    if ( grid->type == GRID_SEPARABLE ) {
+        // 1D transforms along the rows and the columns
+        interpolate_separable_nfft(out, in, w, h, pd, grid->xs, grid->nx,
+                                   grid->ys, grid->ny, 1);
+        return;
+    }
+    
+    // the NFFT needs all the locations
+    double *x, *y;
+    int owned = grid_locations(grid, &x, &y);
+    interpolate_at_locations_nfft(out, in, w, h, pd, x, y, grid->numPixels, 1);
+    if ( owned ) {
+        free(x);
+        free(y);
+    }
+}
+
+// Resampling of an image at given locations
+// using several base interpolation methods
+static void interpolate_at(double **out, double *in, int w, int h, int pd,
+                           char **interp, int nmethods, BoundaryExt bc,
+                           const sampling_grid_t *grid) {
+    // the B-spline methods are gathered to be evaluated in one pass
+    int nsplines = 0;
+    int *orders = malloc(nmethods*sizeof*orders);
+    double **outsplines = malloc(nmethods*sizeof*outsplines);
+    
+    for(int n = 0; n < nmethods; n++) {
+        if (0 == strncmp(interp[n], "bic", 3))
+            bicubic_at(out[n], in, w, h, pd, bc, grid);
+        else if (0 == strncmp(interp[n], "tpi", 3))
+            tpi_at(out[n], in, w, h, pd, grid);
+        else if (0 == strncmp(interp[n], "spline", 6)) {
+            orders[nsplines] = read_spline_order(interp[n]);
+            outsplines[nsplines++] = out[n];
+        }
+        else 
+            printf("Unknown interpolation method...\n");
+    }
+    
+    if ( nsplines ) {
         // precision
         double precision = 1e-12;
         
@@ -106,115 +371,545 @@ static void interpolate_at(double *out, double *in, int w, int h, int pd,
             larger = 1;
         
         // interpolate at locations using B-spline interpolation
-        splinter_at(out, in, w, h, pd, order,
-                    bc, precision, larger, x, y, numPixels);
+        splinter_at(outsplines, in, w, h, pd, orders, nsplines,
+                    bc, precision, larger, grid);
     }
-    else 
-        printf("Unknown interpolation method...\n");
+    
+    free(orders);
+    free(outsplines);
+}
+
+// Images on which the base interpolation methods are applied
+// (the sources at the input resolution come first)
+typedef enum {
+    SOURCE_INPUT = 0,           // input image
+    SOURCE_SMOOTH = 1,          // smooth component of the p+s decomposition
+    SOURCE_PERIODIC = 2,        // periodic component of the p+s decomposition
+    SOURCE_ZOOMED = 3,          // input image up-sampled by TPI (zoom 2)
+    SOURCE_PERIODIC_ZOOMED = 4, // periodic component up-sampled by TPI (zoom 2)
+    NUM_SOURCES = 5
+} InterpolationSource;
+
+// Evaluation of a base interpolation method on a source image
+typedef struct {
+    InterpolationSource source;
+    char method[64]; // base interpolation method
+    double *out;     // interpolated values
+    int owned;       // whether out has been allocated for this evaluation
+    int uses;        // number of methods using this evaluation
+} interpolation_job_t;
+
+// Check if the base method is TPI
+// TPI of an image up-sampled by TPI at the scaled locations is TPI of the
+// image itself (same trigonometric polynomial), so that the up-sampling can
+// be skipped
+static int is_tpi(const char *method) {
+    return 0 == strncmp(method, "tpi", 3) && (method[3] == '\0' || method[3] == '-');
 }
 
-// Resampling of an image at given locations (x,y)
-// using an interpolation method (base, zoomed or p+s)
+// Check if a base method (up to the next '-') can be evaluated
+static int is_valid_base_method(const char *method) {
+    if ( 0 == strncmp(method, "bic", 3) || 0 == strncmp(method, "tpi", 3) )
+        return 1;
+    if ( 0 == strncmp(method, "spline", 6) ) {
+        #ifndef GSL_SUPPORT
+        // the B-splines of larger orders need GSL
+        int order = 0;
+        sscanf(method, "spline%d", &order);
+        if ( order > MAX_TABULATED_ORDER )
+            return 0;
+        #endif
+        return 1;
+    }
+    return 0;
+}
+
+// Check if the interpolation methods (base, zoomed or p+s) can be evaluated
+static int are_valid_methods(char **interp, int nmethods) {
+    for (int n = 0; n < nmethods; n++) {
+        if (0 == strncmp(interp[n], "p+s", 3)) {
+            const char *interp_perio = strchr(interp[n], '-');
+            if ( !interp_perio || !is_valid_base_method(interp_perio + 1)
+                 || !is_valid_base_method(strrchr(interp[n], '-') + 1) )
+                return 0;
+        }
+        else if ( !is_valid_base_method(interp[n]) )
+            return 0;
+    }
+    return 1;
+}
+
+// Add the evaluation of a base method on a source (if not already present)
+// and return its index
+static int add_job(interpolation_job_t *jobs, int *njobs, InterpolationSource source,
+                   const char *method) {
+    // the base method stops at the next '-'
+    char base[64];
+    size_t len = strcspn(method, "-");
+    if ( len > sizeof(base) - 1 )
+        len = sizeof(base) - 1;
+    memcpy(base, method, len);
+    base[len] = '\0';
+    
+    for (int j = 0; j < *njobs; j++)
+        if ( jobs[j].source == source && 0 == strcmp(jobs[j].method, base) ) {
+            jobs[j].uses++;
+            return j;
+        }
+    
+    interpolation_job_t *job = jobs + (*njobs);
+    job->source = source;
+    strcpy(job->method, base);
+    job->out = NULL;
+    job->owned = 0;
+    job->uses = 1;
+    return (*njobs)++;
+}
+
+// List the evaluations of base methods of the interpolation methods
+// (main_job and perio_job give the evaluations used by each method, -1 if none)
+// and return their number
+static int list_jobs(interpolation_job_t *jobs, int *main_job, int *perio_job,
+                     char **interp, int nmethods) {
+    int njobs = 0;
+    for (int n = 0; n < nmethods; n++) {
+        perio_job[n] = -1;
+        if (0 == strncmp(interp[n], "p+s", 3)) {
+            // extract interpolation method for each component
+            char *interp_perio  = strchr(interp[n], '-') + 1;
+            char *interp_smooth = strrchr(interp[n], '-') + 1;
+            main_job[n] = add_job(jobs, &njobs, SOURCE_SMOOTH, interp_smooth);
+            perio_job[n] = add_job(jobs, &njobs, is_tpi(interp_perio) ?
+                                   SOURCE_PERIODIC : SOURCE_PERIODIC_ZOOMED, interp_perio);
+        }
+        else if ( EndsWith(interp[n],"-z2") && !is_tpi(interp[n]) )
+            main_job[n] = add_job(jobs, &njobs, SOURCE_ZOOMED, interp[n]);
+        else
+            main_job[n] = add_job(jobs, &njobs, SOURCE_INPUT, interp[n]);
+    }
+    return njobs;
+}
+
+// Sources and evaluations which need memory besides the input and the outputs
+typedef struct {
+    int used[NUM_SOURCES]; // source images used by the evaluations
+    int nowned;            // evaluations not written directly in the output
+    int nfft;              // TPI evaluated by a 2D NFFT (at all the locations)
+} methods_usage_t;
+
+// Find the sources and the evaluations of the interpolation methods
+// (the outputs of the evaluations used by one method are set to this output)
+static methods_usage_t methods_usage(interpolation_job_t *jobs, int njobs,
+                                     const int *main_job, double **out,
+                                     int nmethods, const sampling_grid_t *grid) {
+    methods_usage_t usage = {{0}, njobs, 0};
+    for (int n = 0; n < nmethods; n++) {
+        interpolation_job_t *job = jobs + main_job[n];
+        if ( job->uses == 1 ) {
+            job->out = out ? out[n] : NULL;
+            usage.nowned--;
+        }
+    }
+    for (int j = 0; j < njobs; j++) {
+        usage.used[jobs[j].source] = 1;
+        if ( is_tpi(jobs[j].method) && grid->type != GRID_SEPARABLE )
+            usage.nfft = 1;
+    }
+    return usage;
+}
+
+// Estimation of the memory (in bytes) used by the evaluation of interpolation
+// methods besides the input: the outputs, and for the channels evaluated at
+// once the evaluations, the source images, the largest spectrum, a working copy
+// of the largest source image (B-spline coefficients) and the NFFT plans and
+// locations of TPI with a given precomputation of the window
+static double methods_memory(const methods_usage_t *usage, int nmethods, int w, int h,
+                             int w2, int h2, int numPixels, int pd, int channels,
+                             TPIPrecompute precompute) {
+    const int *used = usage->used;
+    double memory = (double) usage->nowned*numPixels;
+    double largest = w*h;
+    if ( used[SOURCE_SMOOTH] || used[SOURCE_PERIODIC] || used[SOURCE_PERIODIC_ZOOMED] )
+        memory += w*h;
+    if ( used[SOURCE_PERIODIC] )
+        memory += w*h;
+    if ( used[SOURCE_ZOOMED] || used[SOURCE_PERIODIC_ZOOMED] ) {
+        memory += (used[SOURCE_ZOOMED] + used[SOURCE_PERIODIC_ZOOMED])*w2*h2;
+        largest = (w2+2)*h2;
+    }
+    else if ( used[SOURCE_PERIODIC] )
+        largest = (w+2)*h;
+    memory = sizeof(double)*((double) nmethods*numPixels*pd + channels*(memory + largest));
+    if ( usage->nfft )
+        memory += tpi_memory(w, h, channels, numPixels, 1, precompute)
+                  + sizeof(double)*2*numPixels;
+    return memory;
+}
+
+// Schedule of the evaluation of interpolation methods
+typedef struct {
+    int channels;            // number of channels evaluated at once
+    TPIPrecompute precompute; // precomputation of the TPI window
+    double memory;           // estimated memory in bytes (besides the input)
+    int tight;               // the budget is exceeded by the largest footprint
+} memory_schedule_t;
+
+// Select the schedule with the largest footprint within the memory budget:
+// all the channels at once, then one channel at a time, then a lower
+// precomputation of the TPI window (a warning is printed if the lowest
+// footprint still exceeds the budget)
+static memory_schedule_t select_schedule(const methods_usage_t *usage, int nmethods,
+                                         int w, int h, int w2, int h2,
+                                         int numPixels, int pd) {
+    memory_schedule_t schedule = {pd, get_tpi_precompute(), 0, 0};
+    double budget = max_memory - sizeof(double)*w*h*pd;
+    while ( 1 ) {
+        schedule.memory = methods_memory(usage, nmethods, w, h, w2, h2, numPixels, pd,
+                                         schedule.channels, schedule.precompute);
+        if ( !max_memory || schedule.memory <= budget )
+            break;
+        schedule.tight = 1;
+        if ( schedule.channels > 1 )
+            schedule.channels = 1;
+        else if ( usage->nfft && schedule.precompute > TPI_PRECOMPUTE_NONE )
+            schedule.precompute--;
+        else {
+            static int warned = 0;
+            #ifdef _OPENMP
+            #pragma omp critical (memory_budget)
+            #endif
+            if ( !warned ) {
+                fprintf(stderr, "Estimated memory %.1f MB exceeds the budget %.1f MB\n",
+                        (schedule.memory + sizeof(double)*w*h*pd)/(1 << 20),
+                        max_memory/(1 << 20));
+                warned = 1;
+            }
+            break;
+        }
+    }
+    return schedule;
+}
+
+// Resampling of the channels of an image at given locations
+// using several interpolation methods (base, zoomed or p+s)
 // For the zoomed version this corresponds to Algorithm 3
 // For the p+s version this corresponds to Algorithm 4
-static void interpolate_image_at_method(double *out, double *in, int w, int h,
-                                        int pd, char *interp, BoundaryExt bc,
-                                        double *x, double *y, int numPixels) {
-    if (0 == strncmp(interp, "p+s", 3)) {
-        // periodic plus smooth version (Algorithm 4)
-        int zoom = 2;
-        int wper = w*zoom;
-        int hper = h*zoom;
-        
-        // periodic plus smooth decomposition
-        double *pComp_in_zoomed = malloc(wper*hper*pd*sizeof(double));
-        double *sComp_in = malloc(w*h*pd*sizeof(double));
-        periodic_plus_smooth_decomposition(pComp_in_zoomed, sComp_in,
-                                           in, w, h, pd, zoom);
-        
-        // extract interpolation method for each component
-        char *interp_perio  = strchr(interp, '-') + 1;
-        char *interp_smooth = strrchr(interp, '-') + 1;
-        
-        // interpolate smooth
-        interpolate_at(out, sComp_in, w, h, pd, interp_smooth, bc,
-                       x, y, numPixels);
+// The p+s decomposition, the up-sampled image and the evaluations of a base
+// method on the same image are computed once and shared by the methods
+static void interpolate_channels_at_methods(double **out, double *in, int w, int h,
+                                            int pd, char **interp, int nmethods,
+                                            BoundaryExt bc, sampling_grid_t *grid) {
+    int numPixels = grid->numPixels;
+    int zoom = 2;
+    int w2 = w*zoom;
+    int h2 = h*zoom;
+    
+    // list of the evaluations of base methods
+    // (written directly in the output when possible)
+    interpolation_job_t *jobs = malloc(2*nmethods*sizeof*jobs);
+    int *main_job = malloc(nmethods*sizeof*main_job);
+    int *perio_job = malloc(nmethods*sizeof*perio_job);
+    int njobs = list_jobs(jobs, main_job, perio_job, interp, nmethods);
+    methods_usage_t usage = methods_usage(jobs, njobs, main_job, out, nmethods, grid);
+    const int *used = usage.used;
+    
+    for (int j = 0; j < njobs; j++)
+        if ( !jobs[j].out ) {
+            jobs[j].out = malloc(numPixels*pd*sizeof(double));
+            jobs[j].owned = 1;
+        }
+    
+    double *sources[NUM_SOURCES] = {in, NULL, NULL, NULL, NULL};
+    if ( used[SOURCE_SMOOTH] || used[SOURCE_PERIODIC] || used[SOURCE_PERIODIC_ZOOMED] ) {
+        // periodic plus smooth decomposition (Algorithm 4)
+        // the periodic component is up-sampled only for the methods other than TPI
+        sources[SOURCE_SMOOTH] = malloc(w*h*pd*sizeof(double));
+        if ( used[SOURCE_PERIODIC_ZOOMED] ) {
+            sources[SOURCE_PERIODIC_ZOOMED] = malloc(w2*h2*pd*sizeof(double));
+            periodic_plus_smooth_decomposition(sources[SOURCE_PERIODIC_ZOOMED],
+                                               sources[SOURCE_SMOOTH],
+                                               in, w, h, pd, zoom);
+        }
+        if ( used[SOURCE_PERIODIC] ) {
+            sources[SOURCE_PERIODIC] = malloc(w*h*pd*sizeof(double));
+            if ( used[SOURCE_PERIODIC_ZOOMED] ) {
+                // samples of the up-sampled periodic component (TPI is interpolating)
+                const double *pz = sources[SOURCE_PERIODIC_ZOOMED];
+                for (int l = 0; l < pd; l++)
+                    for (int j = 0; j < h; j++)
+                        for (int i = 0; i < w; i++)
+                            sources[SOURCE_PERIODIC][i + j*w + l*w*h]
+                                = pz[zoom*i + zoom*j*w2 + l*w2*h2];
+            }
+            else
+                periodic_plus_smooth_decomposition(sources[SOURCE_PERIODIC],
+                                                   sources[SOURCE_SMOOTH],
+                                                   in, w, h, pd, 1);
+        }
+    }
+    if ( used[SOURCE_ZOOMED] ) {
+        // up-sample the input image (Algorithm 3)
+        sources[SOURCE_ZOOMED] = malloc(w2*h2*pd*sizeof(double));
+        upsampling(sources[SOURCE_ZOOMED], in, w, h, w2, h2, pd, 1);
+    }
+    
+    // evaluation of the base methods on each source image
+    char **methods = malloc(njobs*sizeof*methods);
+    double **outs = malloc(njobs*sizeof*outs);
+    int scaled = 0;
+    for (int src = 0; src < NUM_SOURCES; src++) {
+        if ( !used[src] )
+            continue;
         
-        // create pixel locations for the zoomed periodic version
-        for (int i = 0; i < numPixels; i++) {
-                x[i] *= zoom;
-                y[i] *= zoom;
+        // create pixel locations for the zoomed sources
+        int zoomed = (src == SOURCE_ZOOMED || src == SOURCE_PERIODIC_ZOOMED);
+        if ( zoomed && !scaled ) {
+            scale_grid(grid, zoom);
+            scaled = 1;
         }
         
-        // interpolate periodic component
-        double *pComp = malloc(numPixels*pd*sizeof(double));
-        interpolate_at(pComp, pComp_in_zoomed, wper, hper, pd,
-                       interp_perio, BOUNDARY_PERIODIC, x, y, numPixels);
+        int nsrc = 0;
+        for (int j = 0; j < njobs; j++)
+            if ( (int) jobs[j].source == src ) {
+                methods[nsrc] = jobs[j].method;
+                outs[nsrc++] = jobs[j].out;
+            }
         
-        // sum
-        for (int k = 0; k < numPixels*pd; k++)
-            out[k] += pComp[k];
+        int periodic = (src == SOURCE_PERIODIC || src == SOURCE_PERIODIC_ZOOMED);
+        BoundaryExt bcsrc = periodic ? BOUNDARY_PERIODIC : bc;
+        interpolate_at(outs, sources[src], zoomed ? w2 : w, zoomed ? h2 : h,
+                       pd, methods, nsrc, bcsrc, grid);
         
-        // free memory
-        free(pComp_in_zoomed);
-        free(sComp_in);
-        free(pComp);
+        // the source image is not needed anymore
+        if ( src != SOURCE_INPUT ) {
+            free(sources[src]);
+            sources[src] = NULL;
+        }
+    }
+    
+    // restore the locations (exact for a power of 2)
+    if ( scaled )
+        scale_grid(grid, 1.0/zoom);
+    
+    // gather the results (sum of the components for the p+s methods)
+    for (int n = 0; n < nmethods; n++) {
+        double *res = jobs[main_job[n]].out;
+        if ( res != out[n] )
+            memcpy(out[n], res, numPixels*pd*sizeof(double));
+        if ( perio_job[n] >= 0 ) {
+            double *pComp = jobs[perio_job[n]].out;
+            for (int k = 0; k < numPixels*pd; k++)
+                out[n][k] += pComp[k];
+        }
+    }
+    
+    // free memory
+    for (int j = 0; j < njobs; j++)
+        if ( jobs[j].owned )
+            free(jobs[j].out);
+    free(jobs);
+    free(main_job);
+    free(perio_job);
+    free(methods);
+    free(outs);
+}
+
+// Resampling of an image at given locations
+// using several interpolation methods (base, zoomed or p+s)
+// When the memory budget is exceeded, the channels are interpolated one at a
+// time, the precomputation of the TPI window is lowered and the NFFT plans
+// kept between the calls are freed after each channel
+static void interpolate_image_at_methods(double **out, double *in, int w, int h,
+                                         int pd, char **interp, int nmethods,
+                                         BoundaryExt bc, sampling_grid_t *grid) {
+    int numPixels = grid->numPixels;
+    
+    // schedule within the memory budget
+    interpolation_job_t *jobs = malloc(2*nmethods*sizeof*jobs);
+    int *main_job = malloc(nmethods*sizeof*main_job);
+    int *perio_job = malloc(nmethods*sizeof*perio_job);
+    int njobs = list_jobs(jobs, main_job, perio_job, interp, nmethods);
+    methods_usage_t usage = methods_usage(jobs, njobs, main_job, NULL, nmethods, grid);
+    memory_schedule_t schedule = select_schedule(&usage, nmethods, w, h, 2*w, 2*h,
+                                                 numPixels, pd);
+    free(jobs);
+    free(main_job);
+    free(perio_job);
+    if ( schedule.precompute < get_tpi_precompute() )
+        limit_tpi_precompute(schedule.precompute);
+    
+    // the plans of the previous calls are not kept under a tight budget
+    if ( schedule.tight )
+        flush_tpi_cache();
+    
+    double **outl = malloc(nmethods*sizeof*outl);
+    for (int l = 0; l < pd; l += schedule.channels) {
+        for (int n = 0; n < nmethods; n++)
+            outl[n] = out[n] + l*numPixels;
+        interpolate_channels_at_methods(outl, in + l*w*h, w, h, schedule.channels,
+                                        interp, nmethods, bc, grid);
+        if ( schedule.tight )
+            flush_tpi_cache();
     }
-    else if ( EndsWith(interp,"-z2") ) { // zoomed version (Algorithm 3)
-        int zoom = 2;
-        int w2 = w*zoom;
-        int h2 = h*zoom;
+    free(outl);
+}
+
+// Memory budget in bytes (0 for no limit)
+double get_max_memory(void) {
+    return max_memory;
+}
+
+// Estimation of the memory (in bytes) used by the geometric transformation of
+// an image besides the input: the outputs, the intermediate images and the NFFT
+// plans of TPI (for a general homography), with the schedule selected within
+// the memory budget
+double interpolation_memory(int w, int h, int pd, char **interp, int nmethods,
+                            float zoom) {
+    if ( !are_valid_methods(interp, nmethods) )
+        return 0;
+    
+    sampling_grid_t grid = {0};
+    grid.type = GRID_HOMOGRAPHY;
+    grid.numPixels = (int) (w/zoom)*(int) (h/zoom);
+    
+    interpolation_job_t *jobs = malloc(2*nmethods*sizeof*jobs);
+    int *main_job = malloc(nmethods*sizeof*main_job);
+    int *perio_job = malloc(nmethods*sizeof*perio_job);
+    int njobs = list_jobs(jobs, main_job, perio_job, interp, nmethods);
+    methods_usage_t usage = methods_usage(jobs, njobs, main_job, NULL, nmethods, &grid);
+    memory_schedule_t schedule = select_schedule(&usage, nmethods, w, h, 2*w, 2*h,
+                                                 grid.numPixels, pd);
+    free(jobs);
+    free(main_job);
+    free(perio_job);
+    return schedule.memory;
+}
 
-        // create pixel locations for the zoomed version
-        for (int i = 0; i < numPixels; i++) {
-                x[i] *= zoom;
-                y[i] *= zoom;
+// Geometric transformation of an image by an integer translation
+// (possibly combined with an integer down-sampling)
+// The pixels whose location is inside the image are copied and the other ones
+// are interpolated. Since the interpolation methods are interpolating this is
+// equivalent to the interpolation of all the pixels.
+static void interpolate_integer_translation(double **out, double *in, int w, int h,
+                                            int pd, double iH[9], char **interp,
+                                            int nmethods, BoundaryExt bc, int zoom,
+                                            int wout, int hout) {
+    int numPixels = wout*hout;
+    int tx = round(iH[2]/iH[8]);
+    int ty = round(iH[5]/iH[8]);
+    
+    // copy the values inside the image and list the other pixels
+    int *outside = malloc(numPixels*sizeof*outside);
+    int noutside = 0;
+    for (int j = 0; j < hout; j++) {
+        int y = j*zoom + ty;
+        for (int i = 0; i < wout; i++) {
+            int x = i*zoom + tx;
+            if ( x >= 0 && x < w && y >= 0 && y < h ) {
+                for (int n = 0; n < nmethods; n++)
+                    for (int l = 0; l < pd; l++)
+                        out[n][j*wout+i + l*numPixels] = in[x + y*w + l*w*h];
+            }
+            else
+                outside[noutside++] = j*wout+i;
+        }
+    }
+    
+    // interpolation of the pixels outside the image
+    if ( noutside ) {
+        sampling_grid_t grid = {0};
+        grid.type = GRID_EXPLICIT;
+        grid.numPixels = noutside;
+        grid.x = malloc(noutside*sizeof(double));
+        grid.y = malloc(noutside*sizeof(double));
+        for (int k = 0; k < noutside; k++) {
+            grid.x[k] = (outside[k] % wout)*zoom + tx;
+            grid.y[k] = (outside[k] / wout)*zoom + ty;
         }
         
-        // up-sample the input image
-        double *in_zoomed = malloc(w2*h2*pd*sizeof(double));
-        upsampling(in_zoomed, in, w, h, w2, h2, pd, 1);
-        
-        // interpolation at locations
-        interpolate_at(out, in_zoomed, w2, h2, pd, interp, bc, x, y, numPixels);
+        double **outk = malloc(nmethods*sizeof*outk);
+        for (int n = 0; n < nmethods; n++)
+            outk[n] = malloc(noutside*pd*sizeof(double));
+        interpolate_image_at_methods(outk, in, w, h, pd, interp, nmethods, bc, &grid);
+        for (int n = 0; n < nmethods; n++) {
+            for (int l = 0; l < pd; l++)
+                for (int k = 0; k < noutside; k++)
+                    out[n][outside[k] + l*numPixels] = outk[n][k + l*noutside];
+            free(outk[n]);
+        }
         
-        // free memory
-        free(in_zoomed);
+        free(outk);
+        free(grid.x);
+        free(grid.y);
     }
-    else
-        interpolate_at(out, in, w, h, pd, interp, bc, x, y, numPixels);
+    
+    free(outside);
 }
 
 // Geometric transformation of an image (by an homography)
-// using an interpolation method
-void interpolate_image_homography(double *out, double *in, int w, int h, int pd,
-                                  double H[9], char *interp, BoundaryExt bc,
-                                  float zoom) {
+// using several interpolation methods (matrix mode)
+// The pixel locations and the preprocessing are shared by the methods
+// The type of the transformation is used to select a specialized path:
+// copy for integer translations, separable interpolation for translations
+// and axis-aligned scalings, and locations generated row by row otherwise
+void interpolate_image_homography_methods(double **out, double *in, int w, int h,
+                                          int pd, double H[9], char **interp,
+                                          int nmethods, BoundaryExt bc, float zoom) {
     // output sizes
     int wout = w/zoom;
     int hout = h/zoom;
     int numPixels = wout*hout;
     
-    // create pixel locations
+    // type of the transformation
     double iH[9];
     invert_homography(iH, H);
-    double *x = malloc(numPixels*sizeof*x);
-    double *y = malloc(numPixels*sizeof*y);
-    double p[2], q[2];
-    for (int j = 0; j < hout; j++) {
-        p[1] = j*zoom;
-        for (int i = 0; i < wout; i++) {
-            p[0] = i*zoom;
-            apply_homography(q, p, iH);
-            x[j*wout+i] = q[0];
-            y[j*wout+i] = q[1];
-        }
+    TransformType type = classify_homography(iH);
+    
+    // integer translation (the grid of locations is the pixel grid)
+    // the invalid methods are reported by the general path
+    if ( type <= TRANSFORM_INTEGER_TRANSLATION && zoom == (int) zoom
+         && are_valid_methods(interp, nmethods) ) {
+        interpolate_integer_translation(out, in, w, h, pd, iH, interp, nmethods,
+                                        bc, zoom, wout, hout);
+        return;
     }
     
-    // interpolation at the locations using the interpolation method
-    interpolate_image_at_method(out, in, w, h, pd, interp, bc, x, y, numPixels);
+    // grid of pixel locations
+    sampling_grid_t grid = {0};
+    grid.numPixels = numPixels;
+    grid.nx = wout;
+    grid.ny = hout;
+    if ( type <= TRANSFORM_SCALING ) {
+        grid.type = GRID_SEPARABLE;
+        grid.xs = malloc(wout*sizeof(double));
+        grid.ys = malloc(hout*sizeof(double));
+        for (int i = 0; i < wout; i++)
+            grid.xs[i] = (iH[0]*(i*zoom) + iH[2])/iH[8];
+        for (int j = 0; j < hout; j++)
+            grid.ys[j] = (iH[4]*(j*zoom) + iH[5])/iH[8];
+    }
+    else {
+        // the locations are generated when needed
+        grid.type = GRID_HOMOGRAPHY;
+        memcpy(grid.iH, iH, 9*sizeof(double));
+        grid.transform = type;
+        grid.zoom = zoom;
+        grid.scale = 1;
+    }
+    
+    // interpolation at the locations using the interpolation methods
+    interpolate_image_at_methods(out, in, w, h, pd, interp, nmethods, bc, &grid);
     
     // free memory
-    free(x);
-    free(y);
+    free(grid.xs);
+    free(grid.ys);
+}
+
+// Geometric transformation of an image (by an homography)
+// using an interpolation method
+void interpolate_image_homography(double *out, double *in, int w, int h, int pd,
+                                  double H[9], char *interp, BoundaryExt bc,
+                                  float zoom) {
+    interpolate_image_homography_methods(&out, in, w, h, pd, H, &interp, 1,
+                                         bc, zoom);
 }
@@ -30,8 +30,18 @@ typedef enum
 
 // Read boundary extension
 BoundaryExt read_ext(const char* boundary);
+// Set the memory budget of the interpolation (size in megabytes or with a suffix K, M, G or T)
+int set_max_memory(const char *size);
+// Memory budget of the interpolation in bytes (0 for no limit)
+double get_max_memory(void);
+// Estimation of the memory (in bytes) used by the transformation of an image besides the input
+double interpolation_memory(int w, int h, int pd, char **interp, int nmethods, float zoom);
 // Geometric transformation of an image (by an homography) using an interpolation method
 void interpolate_image_homography(double *out, double *in, int w, int h, int pd, double H[9], 
                                   char *interp, BoundaryExt boundaryExt, float zoom);
+// Geometric transformation of an image (by an homography) using several interpolation methods
+void interpolate_image_homography_methods(double **out, double *in, int w, int h, int pd,
+                                          double H[9], char **interp, int nmethods,
+                                          BoundaryExt boundaryExt, float zoom);
 
 #endif
\ No newline at end of file
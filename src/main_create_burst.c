@@ -17,6 +17,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "random.h"
 #include "iio.h"
@@ -24,6 +29,7 @@
 #include "interpolation_core.h"
 #include "homography_core.h"
 #include "fft_core.h"
+#include "tpi.h"
 
 #define PAR_DEFAULT_L 3
 #define PAR_DEFAULT_TYPE 8
@@ -50,12 +56,71 @@ void print_help(char *name)
     printf("-z, \t Specify the down-sampling factor (by default %i)\n", PAR_DEFAULT_ZOOM);
     printf("-n, \t Specify the standard deviation of the noise (by default %i)\n", PAR_DEFAULT_SIGMA);
     printf("-s, \t Specify the seed of the random generator (by default %i)\n", PAR_DEFAULT_SEED);
+    printf("-P, \t Specify the FFTW planning level between estimate, measure, patient and exhaustive\n");
+    printf("    \t (by default the FFTW_PLANNING environment variable or estimate)\n");
+    printf("-W, \t Specify a FFTW wisdom file imported at start and updated at exit\n");
+    printf("    \t (by default the FFTW_WISDOM_FILE environment variable)\n");
+    printf("-T, \t Specify the precomputation of the TPI window between none, psi and full\n");
+    printf("    \t (by default the TPI_PRECOMPUTE environment variable or none)\n");
+    printf("-O, \t Specify the oversampling factor of the NFFT used by TPI (by default 2)\n");
+    printf("-M, \t Specify the cut-off of the NFFT window used by TPI (by default 6)\n");
+    printf("-E, \t Specify an error tolerance for TPI: the smallest oversampling factor and cut-off\n");
+    printf("    \t with a smaller error bound are used (the achieved bound is printed)\n");
+    printf("--max-memory, Specify a memory budget in megabytes (or with a suffix K, M, G or T):\n");
+    printf("    \t the channels are interpolated one at a time and the TPI precomputation is lowered\n");
+    printf("    \t when it is exceeded, and the number of frames computed concurrently is limited\n");
+    printf("    \t to the budget (by default no limit)\n");
+}
+
+// Counter-based random generator: the value of index k of a stream is the
+// SplitMix64 finalizer of key + k so that it does not depend on the order
+// in which the values are drawn
+static uint64_t splitmix64(uint64_t z)
+{
+    z += 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Uniform value in (0,1) of index k of the stream of a key (53 random bits)
+static double counter_uniform(uint64_t key, uint64_t k)
+{
+    return ((splitmix64(key + k) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Add a Gaussian noise of standard deviation sigma to a frame of the burst
+// The noise of a sample only depends on the seed, the frame and the index of
+// the sample. The Box-Muller transform of each pair of uniform values gives
+// the noise of two consecutive samples.
+static void add_noise(double *out, int size, double sigma, unsigned long seed, int frame)
+{
+    uint64_t key = splitmix64(splitmix64(seed) + frame);
+    int npairs = size/2;
+
+    #ifdef _OPENMP
+    #pragma omp simd
+    #endif
+    for (int k = 0; k < npairs; k++) {
+        double r = sigma*sqrt(-2*log(counter_uniform(key, 2*k)));
+        double t = 2*M_PI*counter_uniform(key, 2*k+1);
+        out[2*k] += r*cos(t);
+        out[2*k+1] += r*sin(t);
+    }
+
+    if ( size%2 ) {
+        double r = sigma*sqrt(-2*log(counter_uniform(key, size-1)));
+        out[size-1] += r*cos(2*M_PI*counter_uniform(key, size));
+    }
 }
 
 // read command line parameters
 static int read_parameters(int argc, char *argv[], char **infile, char **outfile,
                            int *n, char **interp, char **boundary, double *L, int *type,
-                           double *zoom, int *crop, double *sigma, unsigned long *seed)
+                           double *zoom, int *crop, double *sigma, unsigned long *seed,
+                           char **planning, char **wisdom, char **precompute,
+                           double *oversampling, int *cutoff, double *tolerance,
+                           char **memory)
 {
     // display usage
     if (argc < 4) {
@@ -77,6 +142,13 @@ static int read_parameters(int argc, char *argv[], char **infile, char **outfile
         *sigma     = PAR_DEFAULT_SIGMA;
         *crop      = PAR_DEFAULT_CROP;
         *seed      = PAR_DEFAULT_SEED;
+        *planning  = NULL;
+        *wisdom    = NULL;
+        *precompute = NULL;
+        *oversampling = 0;
+        *cutoff = 0;
+        *tolerance = 0;
+        *memory = NULL;
         
         //read each parameter from the command line
         while(i < argc) {
@@ -112,6 +184,34 @@ static int read_parameters(int argc, char *argv[], char **infile, char **outfile
                 if(i < argc-1)
                     *seed = atoi(argv[++i]);
 
+            if(strcmp(argv[i],"-P")==0)
+                if(i < argc-1)
+                    *planning = argv[++i];
+
+            if(strcmp(argv[i],"-W")==0)
+                if(i < argc-1)
+                    *wisdom = argv[++i];
+
+            if(strcmp(argv[i],"-T")==0)
+                if(i < argc-1)
+                    *precompute = argv[++i];
+
+            if(strcmp(argv[i],"-O")==0)
+                if(i < argc-1)
+                    *oversampling = atof(argv[++i]);
+
+            if(strcmp(argv[i],"-M")==0)
+                if(i < argc-1)
+                    *cutoff = atoi(argv[++i]);
+
+            if(strcmp(argv[i],"-E")==0)
+                if(i < argc-1)
+                    *tolerance = atof(argv[++i]);
+
+            if(strcmp(argv[i],"--max-memory")==0)
+                if(i < argc-1)
+                    *memory = argv[++i];
+
             i++;
         }
         
@@ -127,15 +227,37 @@ static int read_parameters(int argc, char *argv[], char **infile, char **outfile
 
 int main(int c, char *v[])
 {
-    char *filename_in, *base_out, *interp, *boundary;
+    char *filename_in, *base_out, *interp, *boundary, *planning, *wisdom, *precompute, *memory;
+    double oversampling, tolerance;
+    int cutoff;
     int n, type, crop;
     unsigned long seed;
     double L, zoom, sigma;
     
     int result = read_parameters(c, v, &filename_in, &base_out, &n, &interp, &boundary,
-                                 &L, &type, &zoom, &crop, &sigma, &seed);
+                                 &L, &type, &zoom, &crop, &sigma, &seed,
+                                 &planning, &wisdom, &precompute,
+                                 &oversampling, &cutoff, &tolerance, &memory);
 
     if ( result ) {
+        // FFTW planning options
+        if ( planning )
+            set_fftw_planning(planning);
+        if ( wisdom )
+            set_fftw_wisdom(wisdom);
+
+        // TPI options
+        if ( precompute )
+            set_tpi_precompute(precompute);
+        if ( oversampling || cutoff )
+            set_tpi_parameters(oversampling, cutoff);
+        if ( tolerance )
+            set_tpi_tolerance(tolerance);
+
+        // memory budget
+        if ( memory )
+            set_max_memory(memory);
+
         // initialize FFTW
         init_fftw();
         
@@ -203,42 +325,86 @@ int main(int c, char *v[])
         // compute images
         int wout = w/zoom;
         int hout = h/zoom;
-        char filename_out[500];
-        double *out = malloc(wout*hout*pd*sizeof*out);
-        
-        for (int j = 0; j < n; j++) {
-            for(int i = 0; i < 9; i++)
-                H[i] = homographies[9*j+i];
-            
-            // apply geometric transformation to the input
-            interpolate_image_homography(out, in, w, h, pd, H, interp, boundaryExt, zoom);
-            
-            // add noise
-            if ( sigma > 0 )
-                for(int i = 0; i < wout*hout*pd; i++)
-                    out[i] += sigma*random_normal();
-            
-            // write transformed image
-            sprintf(filename_out, "%s_%i.tiff", base_out, j+1);
-            iio_write_image_double_split(filename_out, out, wout, hout, pd);
-            
-            // crop case
-            if ( crop ) {
-                int wcrop = wout - 2*crop;
-                int hcrop = hout - 2*crop;
-                double *out_crop = malloc(wcrop*hcrop*pd*sizeof(double));
-                
-                for(int l = 0; l < pd; l++)
-                    for(int q = 0; q < hcrop; q++)
-                        for(int p = 0; p < wcrop; p++)
-                            out_crop[p + q*wcrop + l*wcrop*hcrop] = out[p + crop + (q+crop)*wout + l*wout*hout];
-                
-                sprintf(filename_out, "%s_crop_%i.tiff", base_out, j+1);
-                iio_write_image_double_split(filename_out, out_crop, wcrop, hcrop, pd);
-                free(out_crop);
+
+        // the frames are computed concurrently and the remaining threads
+        // are used for the interpolation of each frame
+        #ifdef _OPENMP
+        int nthreads = omp_get_max_threads();
+        int frame_threads = (n < nthreads) ? n : nthreads;
+
+        // the frames computed concurrently fit in the memory budget
+        // (the input image is shared by the frames, and TPI uses one NFFT
+        // plan per frame when the frames are computed concurrently)
+        double budget = get_max_memory();
+        if ( budget ) {
+            omp_set_num_threads(1);
+            double frame_memory = interpolation_memory(w, h, pd, &interp, 1, zoom);
+            omp_set_num_threads(nthreads);
+            if ( crop )
+                frame_memory += (wout - 2*crop)*(hout - 2*crop)*pd*sizeof(double);
+            double frames = (budget - w*h*pd*sizeof(double))/frame_memory;
+            if ( frames < frame_threads )
+                frame_threads = frames;
+        }
+        if ( frame_threads < 1 )
+            frame_threads = 1;
+        int inner = nthreads/frame_threads;
+        int levels = omp_get_max_active_levels();
+        if ( frame_threads > 1 && inner > 1 )
+            omp_set_max_active_levels(2);
+        #pragma omp parallel num_threads(frame_threads)
+        #endif
+        {
+            #ifdef _OPENMP
+            omp_set_num_threads(inner);
+            #endif
+            char filename_out[500];
+            double *out = malloc(wout*hout*pd*sizeof*out);
+
+            #ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+            #endif
+            for (int j = 0; j < n; j++) {
+                // apply geometric transformation to the input
+                interpolate_image_homography(out, in, w, h, pd, homographies + 9*j,
+                                             interp, boundaryExt, zoom);
+
+                // add noise
+                if ( sigma > 0 )
+                    add_noise(out, wout*hout*pd, sigma, seed, j);
+
+                // write transformed image
+                sprintf(filename_out, "%s_%i.tiff", base_out, j+1);
+                #ifdef _OPENMP
+                #pragma omp critical (burst_write)
+                #endif
+                iio_write_image_double_split(filename_out, out, wout, hout, pd);
+
+                // crop case
+                if ( crop ) {
+                    int wcrop = wout - 2*crop;
+                    int hcrop = hout - 2*crop;
+                    double *out_crop = malloc(wcrop*hcrop*pd*sizeof(double));
+
+                    for(int l = 0; l < pd; l++)
+                        for(int q = 0; q < hcrop; q++)
+                            for(int p = 0; p < wcrop; p++)
+                                out_crop[p + q*wcrop + l*wcrop*hcrop] = out[p + crop + (q+crop)*wout + l*wout*hout];
+
+                    sprintf(filename_out, "%s_crop_%i.tiff", base_out, j+1);
+                    #ifdef _OPENMP
+                    #pragma omp critical (burst_write)
+                    #endif
+                    iio_write_image_double_split(filename_out, out_crop, wcrop, hcrop, pd);
+                    free(out_crop);
+                }
             }
-            
+
+            free(out);
         }
+        #ifdef _OPENMP
+        omp_set_max_active_levels(levels);
+        #endif
 
         // final time and print time
         unsigned long t2 = xmtime();
@@ -247,7 +413,7 @@ int main(int c, char *v[])
         // free memory
         free(in);
         free(homographies);
-        free(out);
+        clean_tpi();
         clean_fftw();
     }
     
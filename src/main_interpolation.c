@@ -23,6 +23,7 @@
 #include "interpolation_core.h"
 #include "homography_core.h"
 #include "fft_core.h"
+#include "tpi.h"
 
 #define PAR_DEFAULT_INVERSE 0
 
@@ -32,8 +33,23 @@ void print_help(char *name)
     printf("\n<Usage>: %s input output \"h11 h12 h13 h21 h22 h23 h31 h32 h33\" [OPTIONS]\n\n", name);
     printf("The optional parameters are:\n");
     printf("-i, \t Specify the interpolation method (by default p+s-spline11-spline1)\n");
+    printf("    \t Several methods can be given as a comma-separated list \"m1,m2,...\"\n");
+    printf("    \t in which case the outputs are written as output_m1.ext, output_m2.ext, ...\n");
     printf("-b, \t Specify the boundary condition between hsym, wsym, per and constant (by default hsym)\n");
     printf("-t, \t Set to 1 to apply the inverse transform (by default %i)\n", PAR_DEFAULT_INVERSE);  
+    printf("-P, \t Specify the FFTW planning level between estimate, measure, patient and exhaustive\n");
+    printf("    \t (by default the FFTW_PLANNING environment variable or estimate)\n");
+    printf("-W, \t Specify a FFTW wisdom file imported at start and updated at exit\n");
+    printf("    \t (by default the FFTW_WISDOM_FILE environment variable)\n");
+    printf("-T, \t Specify the precomputation of the TPI window between none, psi and full\n");
+    printf("    \t (by default the TPI_PRECOMPUTE environment variable or none)\n");
+    printf("-O, \t Specify the oversampling factor of the NFFT used by TPI (by default 2)\n");
+    printf("-M, \t Specify the cut-off of the NFFT window used by TPI (by default 6)\n");
+    printf("-E, \t Specify an error tolerance for TPI: the smallest oversampling factor and cut-off\n");
+    printf("    \t with a smaller error bound are used (the achieved bound is printed)\n");
+    printf("--max-memory, Specify a memory budget in megabytes (or with a suffix K, M, G or T):\n");
+    printf("    \t the channels are interpolated one at a time and the TPI precomputation is lowered\n");
+    printf("    \t when it is exceeded (by default no limit)\n");
 }
 
 // Function to transform char of the form "v0 v1 ..." into an array
@@ -52,7 +68,10 @@ static int parse_doubles(double *t, int nmax, const char *s)
 
 // read command line parameters
 static int read_parameters(int argc, char *argv[], char **infile, char **outfile,
-                           char **params, char **interp, char **boundary, int *inverse)
+                           char **params, char **interp, char **boundary, int *inverse,
+                           char **planning, char **wisdom, char **precompute,
+                           double *oversampling, int *cutoff, double *tolerance,
+                           char **memory)
 {
     // display usage
     if (argc < 4) {
@@ -69,6 +88,13 @@ static int read_parameters(int argc, char *argv[], char **infile, char **outfile
         *interp   = "p+s-spline11-spline1";
         *boundary = "hsym";
         *inverse  = PAR_DEFAULT_INVERSE;
+        *planning = NULL;
+        *wisdom   = NULL;
+        *precompute = NULL;
+        *oversampling = 0;
+        *cutoff = 0;
+        *tolerance = 0;
+        *memory = NULL;
         
         //read each parameter from the command line
         while(i < argc) {
@@ -84,6 +110,34 @@ static int read_parameters(int argc, char *argv[], char **infile, char **outfile
                 if(i < argc-1)
                     *inverse = atoi(argv[++i]);
 
+            if(strcmp(argv[i],"-P")==0)
+                if(i < argc-1)
+                    *planning = argv[++i];
+
+            if(strcmp(argv[i],"-W")==0)
+                if(i < argc-1)
+                    *wisdom = argv[++i];
+
+            if(strcmp(argv[i],"-T")==0)
+                if(i < argc-1)
+                    *precompute = argv[++i];
+
+            if(strcmp(argv[i],"-O")==0)
+                if(i < argc-1)
+                    *oversampling = atof(argv[++i]);
+
+            if(strcmp(argv[i],"-M")==0)
+                if(i < argc-1)
+                    *cutoff = atoi(argv[++i]);
+
+            if(strcmp(argv[i],"-E")==0)
+                if(i < argc-1)
+                    *tolerance = atof(argv[++i]);
+
+            if(strcmp(argv[i],"--max-memory")==0)
+                if(i < argc-1)
+                    *memory = argv[++i];
+
             i++;
         }
         
@@ -95,13 +149,34 @@ static int read_parameters(int argc, char *argv[], char **infile, char **outfile
 // using an interpolation method
 int main(int c, char *v[])
 {
-    char *filename_in, *filename_out, *input_params, *interp, *boundary;
+    char *filename_in, *filename_out, *input_params, *interp, *boundary, *planning, *wisdom, *precompute, *memory;
+    double oversampling, tolerance;
+    int cutoff;
     int inverse;
     
     int result = read_parameters(c, v, &filename_in, &filename_out, &input_params, &interp,
-                                 &boundary, &inverse);
+                                 &boundary, &inverse, &planning, &wisdom, &precompute,
+                                 &oversampling, &cutoff, &tolerance, &memory);
 
     if ( result ) {
+        // FFTW planning options
+        if ( planning )
+            set_fftw_planning(planning);
+        if ( wisdom )
+            set_fftw_wisdom(wisdom);
+
+        // TPI options
+        if ( precompute )
+            set_tpi_precompute(precompute);
+        if ( oversampling || cutoff )
+            set_tpi_parameters(oversampling, cutoff);
+        if ( tolerance )
+            set_tpi_tolerance(tolerance);
+
+        // memory budget
+        if ( memory )
+            set_max_memory(memory);
+
         // initialize FFTW
         init_fftw();
         
@@ -131,22 +206,52 @@ int main(int c, char *v[])
         //Boudary condition 
         BoundaryExt boundaryExt = read_ext(boundary);
 
+        // list of interpolation methods
+        int nmethods = 0;
+        char **methods = malloc((strlen(interp)/2+1)*sizeof*methods);
+        for (char *m = strtok(interp, ","); m; m = strtok(NULL, ","))
+            methods[nmethods++] = m;
+        if ( !nmethods ) {
+            fprintf(stderr,"Incorrect interpolation method\n");
+            return EXIT_FAILURE;
+        }
+
         // memory allocation
-        double *out = malloc(w*h*pd*sizeof*out);
+        double **out = malloc(nmethods*sizeof*out);
+        for (int n = 0; n < nmethods; n++)
+            out[n] = malloc(w*h*pd*sizeof(double));
 
         // homographic transformation of the image
-        interpolate_image_homography(out, in, w, h, pd, H, interp, boundaryExt, 1);
+        // (the preprocessing is shared when several methods are given)
+        interpolate_image_homography_methods(out, in, w, h, pd, H, methods,
+                                             nmethods, boundaryExt, 1);
 
         // final time and print time
         unsigned long t2 = xmtime();
         printf("Interpolation made in %.3f seconds \n", (float) (t2-t1)/1000);
 
-        // write output image
-        iio_write_image_double_split(filename_out, out, w, h, pd);
+        // write output images
+        if ( nmethods == 1 )
+            iio_write_image_double_split(filename_out, out[0], w, h, pd);
+        else {
+            // the method is inserted before the extension
+            char *ext = strrchr(filename_out, '.');
+            int len = ext ? (int) (ext - filename_out) : (int) strlen(filename_out);
+            char filename[1000];
+            for (int n = 0; n < nmethods; n++) {
+                snprintf(filename, sizeof(filename), "%.*s_%s%s", len, filename_out,
+                         methods[n], ext ? ext : "");
+                iio_write_image_double_split(filename, out[n], w, h, pd);
+            }
+        }
 
         // free memory
         free(in);
+        for (int n = 0; n < nmethods; n++)
+            free(out[n]);
         free(out);
+        free(methods);
+        clean_tpi();
         clean_fftw();
     }
     
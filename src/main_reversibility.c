@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: GPL-2.0+
+ *
+ * Thibaud Briand <briand.thibaud@gmail.com>
+ *
+ * Copyright (c) 2018-2019, Thibaud Briand
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Pulic License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "iio.h"
+#include "xmtime.h"
+#include "interpolation_core.h"
+#include "homography_core.h"
+#include "fft_core.h"
+#include "tpi.h"
+#include "compute_core.h"
+
+#define PAR_DEFAULT_CROP 20
+#define PAR_DEFAULT_RATIO 0.01
+
+// display help usage
+void print_help(char *name)
+{
+    printf("\n<Usage>: %s input \"hx1 hy1 hx2 hy2 hx3 hy3 hx4 hy4\" [OPTIONS]\n\n", name);
+    printf("\t The transformation is given by the displacement of the four corners\n");
+    printf("\t or by the coefficients \"h11 h12 h13 h21 h22 h23 h31 h32 h33\" of an homography\n");
+    printf("\nThe optional parameters are:\n");
+    printf("-c, \t Specify the crop size (by default %i)\n", PAR_DEFAULT_CROP);
+    printf("-i, \t Specify the interpolation method (by default p+s-spline11-spline1)\n");
+    printf("-b, \t Specify the boundary condition between hsym, wsym, per and constant (by default hsym)\n");
+    printf("-r, \t Specify the ratio of clipped high-frequencies (by default %lf)\n", PAR_DEFAULT_RATIO);
+    printf("-o, \t Specify a base name for writing base.tiff (transformed image),\n");
+    printf("    \t base_crop.tiff (cropped input) and base_inverse.tiff (cropped result)\n");
+    printf("-P, \t Specify the FFTW planning level between estimate, measure, patient and exhaustive\n");
+    printf("    \t (by default the FFTW_PLANNING environment variable or estimate)\n");
+    printf("-W, \t Specify a FFTW wisdom file imported at start and updated at exit\n");
+    printf("    \t (by default the FFTW_WISDOM_FILE environment variable)\n");
+    printf("-T, \t Specify the precomputation of the TPI window between none, psi and full\n");
+    printf("    \t (by default the TPI_PRECOMPUTE environment variable or none)\n");
+    printf("-O, \t Specify the oversampling factor of the NFFT used by TPI (by default 2)\n");
+    printf("-M, \t Specify the cut-off of the NFFT window used by TPI (by default 6)\n");
+    printf("-E, \t Specify an error tolerance for TPI: the smallest oversampling factor and cut-off\n");
+    printf("    \t with a smaller error bound are used (the achieved bound is printed)\n");
+    printf("--max-memory, Specify a memory budget in megabytes (or with a suffix K, M, G or T):\n");
+    printf("    \t the channels are interpolated one at a time and the TPI precomputation is lowered\n");
+    printf("    \t when it is exceeded (by default no limit)\n");
+}
+
+// Function to transform char of the form "v0 v1 ..." into an array
+// of doubles t where t[i] = vi.
+// Taken from parsenumbers.c in the imscript repository:
+// https://github.com/mnhrdt/imscript
+static int parse_doubles(double *t, int nmax, const char *s)
+{
+    int i = 0, w;
+    while (i < nmax && 1 == sscanf(s, "%lg %n", t + i, &w)) {
+            i += 1;
+            s += w;
+    }
+    return i;
+}
+
+// read command line parameters
+static int read_parameters(int argc, char *argv[], char **infile, char **params,
+                           int *crop, char **interp, char **boundary, double *ratio,
+                           char **base, char **planning, char **wisdom, char **precompute,
+                           double *oversampling, int *cutoff, double *tolerance,
+                           char **memory)
+{
+    // display usage
+    if (argc < 3) {
+        print_help(argv[0]);
+        return 0;
+    }
+    else {
+        int i = 1;
+        *infile = argv[i++];
+        *params = argv[i++];
+
+        // "default" value initialization
+        *crop     = PAR_DEFAULT_CROP;
+        *interp   = "p+s-spline11-spline1";
+        *boundary = "hsym";
+        *ratio    = PAR_DEFAULT_RATIO;
+        *base     = NULL;
+        *planning = NULL;
+        *wisdom   = NULL;
+        *precompute = NULL;
+        *oversampling = 0;
+        *cutoff = 0;
+        *tolerance = 0;
+        *memory = NULL;
+
+        //read each parameter from the command line
+        while(i < argc) {
+            if(strcmp(argv[i],"-c")==0)
+                if(i < argc-1)
+                    *crop = atoi(argv[++i]);
+
+            if(strcmp(argv[i],"-i")==0)
+                if(i < argc-1)
+                    *interp = argv[++i];
+
+            if(strcmp(argv[i],"-b")==0)
+                if(i < argc-1)
+                    *boundary = argv[++i];
+
+            if(strcmp(argv[i],"-r")==0)
+                if(i < argc-1)
+                    *ratio = atof(argv[++i]);
+
+            if(strcmp(argv[i],"-o")==0)
+                if(i < argc-1)
+                    *base = argv[++i];
+
+            if(strcmp(argv[i],"-P")==0)
+                if(i < argc-1)
+                    *planning = argv[++i];
+
+            if(strcmp(argv[i],"-W")==0)
+                if(i < argc-1)
+                    *wisdom = argv[++i];
+
+            if(strcmp(argv[i],"-T")==0)
+                if(i < argc-1)
+                    *precompute = argv[++i];
+
+            if(strcmp(argv[i],"-O")==0)
+                if(i < argc-1)
+                    *oversampling = atof(argv[++i]);
+
+            if(strcmp(argv[i],"-M")==0)
+                if(i < argc-1)
+                    *cutoff = atoi(argv[++i]);
+
+            if(strcmp(argv[i],"-E")==0)
+                if(i < argc-1)
+                    *tolerance = atof(argv[++i]);
+
+            if(strcmp(argv[i],"--max-memory")==0)
+                if(i < argc-1)
+                    *memory = argv[++i];
+
+            i++;
+        }
+
+        // sanity check
+        *crop = (*crop >= 0) ? *crop : PAR_DEFAULT_CROP;
+        *ratio = (*ratio >= 0 && *ratio <= 1) ? *ratio : PAR_DEFAULT_RATIO;
+
+        return 1;
+    }
+}
+
+// Main function for computing the reversibility errors of an interpolation method
+// for one transformation (Algorithm 2 with Ntransf=1)
+// All the steps are done in memory (no intermediate image is written)
+int main(int c, char *v[])
+{
+    char *filename_in, *input_params, *interp, *boundary, *base, *planning, *wisdom, *precompute, *memory;
+    double oversampling, tolerance;
+    int cutoff;
+    int crop;
+    double ratio;
+
+    int result = read_parameters(c, v, &filename_in, &input_params, &crop, &interp,
+                                 &boundary, &ratio, &base, &planning, &wisdom, &precompute,
+                                 &oversampling, &cutoff, &tolerance, &memory);
+
+    if ( result ) {
+        // FFTW planning options
+        if ( planning )
+            set_fftw_planning(planning);
+        if ( wisdom )
+            set_fftw_wisdom(wisdom);
+
+        // TPI options
+        if ( precompute )
+            set_tpi_precompute(precompute);
+        if ( oversampling || cutoff )
+            set_tpi_parameters(oversampling, cutoff);
+        if ( tolerance )
+            set_tpi_tolerance(tolerance);
+
+        // memory budget
+        if ( memory )
+            set_max_memory(memory);
+
+        // initialize FFTW
+        init_fftw();
+
+        // read image
+        int w, h, pd;
+        double *in = iio_read_image_double_split(filename_in, &w, &h, &pd);
+
+        // check sizes
+        if ( 4*crop >= w || 4*crop >= h ) {
+            fprintf(stderr, "Crop size too large for a %ix%i image\n", w, h);
+            return EXIT_FAILURE;
+        }
+
+        // initialize time
+        unsigned long t1 = xmtime();
+
+        // Read transformation (displacement of the corners or homography)
+        double H[9], params[9];
+        int nparams = parse_doubles(params, 9, input_params);
+        if ( nparams == 8 )
+            homography_from_corners(H, w, h, params);
+        else if ( nparams == 9 )
+            memcpy(H, params, 9*sizeof(double));
+        else {
+            fprintf(stderr,"Incorrect input transformation\n");
+            return EXIT_FAILURE;
+        }
+
+        printf("Transformation by the homography: ");
+        for (int i = 0; i < 9; i++)
+            printf("%1.16lg%c", H[i], i==8 ? '\n' : ' ');
+
+        //Boudary condition
+        BoundaryExt boundaryExt = read_ext(boundary);
+
+        // memory allocation
+        double *out = malloc(w*h*pd*sizeof*out);
+        double *back = malloc(w*h*pd*sizeof*back);
+
+        // direct interpolation (Line 2)
+        interpolate_image_homography(out, in, w, h, pd, H, interp, boundaryExt, 1);
+        if ( base ) {
+            char filename_out[500];
+            sprintf(filename_out, "%s.tiff", base);
+            iio_write_image_double_split(filename_out, out, w, h, pd);
+        }
+
+        // crop (Line 3)
+        int wc, hc;
+        crop_double(out, &wc, &hc, out, w, h, pd, crop, crop, -crop, -crop);
+
+        // inverse transformation of the translated homography (Line 4)
+        double Hc[9], iHc[9];
+        translate_homography(Hc, H, crop, crop);
+        invert_homography(iHc, Hc);
+        interpolate_image_homography(back, out, wc, hc, pd, iHc, interp, boundaryExt, 1);
+
+        // crop of the result and of the input
+        int wr, hr;
+        crop_double(back, &wr, &hr, back, wc, hc, pd, crop, crop, -crop, -crop);
+        crop_double(in, &wr, &hr, in, w, h, pd, 2*crop, 2*crop, -2*crop, -2*crop);
+        if ( base ) {
+            char filename_out[500];
+            sprintf(filename_out, "%s_crop.tiff", base);
+            iio_write_image_double_split(filename_out, in, wr, hr, pd);
+            sprintf(filename_out, "%s_inverse.tiff", base);
+            iio_write_image_double_split(filename_out, back, wr, hr, pd);
+        }
+
+        // difference image
+        for (int i = 0; i < wr*hr*pd; i++)
+            back[i] = in[i] - back[i];
+
+        // compute reversibility errors (Line 5 to 7)
+        double error = rmse(back, wr*hr*pd);
+        spectrum_clipping(back, back, wr, hr, pd, ratio);
+        double clipped_error = rmse(back, wr*hr*pd);
+
+        // final time and print time
+        unsigned long t2 = xmtime();
+        printf("Reversibility error: %1.14lg\n", error);
+        printf("Clipped reversibility error: %1.14lg\n", clipped_error);
+        printf("Reversibility errors computed in %.3f seconds \n", (float) (t2-t1)/1000);
+
+        // free memory
+        free(in);
+        free(out);
+        free(back);
+        clean_tpi();
+        clean_fftw();
+    }
+
+    return EXIT_SUCCESS;
+}
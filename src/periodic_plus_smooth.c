@@ -28,69 +28,76 @@
 #define M_PI 3.14159265358979323846
 #endif                          /* !M_PI */
 
-// Compute the jumps at the boundary of the image
-static void jumps(double *out, const double *in, int w, int h, int pd)
+// Compute the DFT of the periodic component of an image
+// The DFT of the smooth component is removed from the DFT of the image.
+// It is the DFT of the jumps at the boundary divided by 4-2cos-2cos.
+// The horizontal jumps a(y) are on the columns 0 and w-1 (with opposite signs)
+// and the vertical jumps b(x) on the rows 0 and h-1 so that the DFT of the
+// jumps image is A(j)(1 - exp(2i pi i/w)) + B(i)(1 - exp(2i pi j/h))
+// where A and B are the 1D DFTs of a and b
+static void compute_periodic_fourier(fft_complex *phat, const double *in, int w, int h, int pd)
 {
-    // initialization
-    for (int i = 0; i < w*h*pd; i++)
-        out[i] = 0;
-    
-    // loop over the channels
+    // DFT of the image
+    do_fft_real(phat, in, w, h, pd);
+
+    // size of the half spectrum
+    int wh = w/2+1;
+
+    // memory allocation
+    fft_complex *a = FFTW(malloc)(h*pd*sizeof*a);
+    fft_complex *b = FFTW(malloc)(w*pd*sizeof*b);
+    fft_complex *ew = FFTW(malloc)(wh*sizeof*ew);
+    fft_complex *eh = FFTW(malloc)(h*sizeof*eh);
+    double *cw = malloc(wh*sizeof*cw);
+    double *ch = malloc(h*sizeof*ch);
+
+    // jumps along the boundary
     for (int l = 0; l < pd; l++) {
-        // horizontal jumps
-        for (int j = 0; j < h; j++) {
-                out[j*w + l*w*h] = in[j*w + l*w*h] - in[j*w + w-1 + l*w*h];  
-                out[j*w + w-1 + l*w*h] -= in[j*w + l*w*h] - in[j*w + w-1 + l*w*h];
-        }
-        // vertical jumps    
-        for (int i = 0; i < w; i++) {
-            out[i + l*w*h] += in[i + l*w*h] - in[(h-1)*w + i + l*w*h];    
-            out[(h-1)*w + i + l*w*h] -= in[i + l*w*h] - in[(h-1)*w + i + l*w*h]; 
-        }
+        for (int j = 0; j < h; j++)
+            a[j + l*h] = in[j*w + l*w*h] - in[j*w + w-1 + l*w*h];
+        for (int i = 0; i < w; i++)
+            b[i + l*w] = in[i + l*w*h] - in[(h-1)*w + i + l*w*h];
     }
-}
 
-// Compute the smooth component of an image using Fourier computations
-static void compute_smooth_component(fftw_complex *shat, const double *in, int w, int h, int pd)
-{
-    // allocate memory
-    double *v = (double *) malloc(w*h*pd*sizeof*v);
-    
-    // compute jumps
-    jumps(v, in, w, h, pd);
-    
-    // compute the fft of jumps
-    do_fft_real(shat, v, w, h, pd);
+    // 1D DFTs of the jumps
+    do_dft_rows(a, h, pd, FFTW_FORWARD);
+    do_dft_rows(b, w, pd, FFTW_FORWARD);
 
-    double tmp;
+    // phase factors of the opposite sides and separable denominator 4-2cos-2cos
     double factorh = 2*M_PI/h;
     double factorw = 2*M_PI/w;
+    for (int i = 0; i < wh; i++) {
+        ew[i] = 1.0 - cexp(I*i*factorw);
+        cw[i] = 2*cos(i*factorw);
+    }
+    for (int j = 0; j < h; j++) {
+        eh[j] = 1.0 - cexp(I*j*factorh);
+        ch[j] = 4-2*cos(j*factorh);
+    }
+
+    double tmp;
     for (int j = 0; j < h; j++)
-        for (int i = 0; i < w; i++) {
-            tmp = 1.0/(4-2*cos(j*factorh)-2*cos(i*factorw));
+        for (int i = 0; i < wh; i++) {
+            tmp = (i || j) ? 1.0/(ch[j]-cw[i]) : 0.0; // the mean is set to 0
             for (int l = 0; l < pd; l++)
-                shat[j*w+i+l*w*h] = shat[j*w+i+l*w*h]*tmp;
+                phat[j*wh+i+l*wh*h] -= (a[j + l*h]*ew[i] + b[i + l*w]*eh[j])*tmp;
         }
-    
-    // set the mean to 0
-    for (int l = 0; l < pd; l++)
-                shat[l*w*h] = 0.0;
-    
-    // free memory
-    free(v);
-}
 
-// Compute the periodic component
-static void compute_periodic_component(double *periodic, const double *smooth,
-                                       const double *in, int w, int h, int pd)
-{
-    // difference of inhat and shat
-    for (int i = 0; i < pd*w*h; i++)
-        periodic[i] = in[i] - smooth[i];
+    // free memory
+    FFTW(free)(a);
+    FFTW(free)(b);
+    FFTW(free)(ew);
+    FFTW(free)(eh);
+    free(cw);
+    free(ch);
 }
 
 // Compute the periodic plus smooth decomposition of an image
 // The periodic component is possibly zoomed by TPI
+// Only the DFT of the image and the inverse DFT of the zoomed periodic
+// component are computed: TPI is interpolating so that the smooth component
+// is the difference between the image and the samples of the zoomed
+// periodic component
 void periodic_plus_smooth_decomposition(double *periodic, double *smooth, const double *in,
                                         int w, int h, int pd, int zoom)
 {
@@ -98,27 +105,25 @@ void periodic_plus_smooth_decomposition(double *periodic, double *smooth, const
     int hout = zoom*h;
     int wout = zoom*w;
 
-    // memory allocation
-    fftw_complex *shat = malloc(w*h*pd*sizeof*shat);
-    fftw_complex *phat = malloc(w*h*pd*sizeof*phat);
-    fftw_complex *phat_zoom = malloc(wout*hout*pd*sizeof*phat_zoom);
-    
-    // compute smooth component
-    compute_smooth_component(shat, in, w, h, pd);
-    do_ifft_real(smooth, shat, w, h, pd);
-
-    // compute the zoomed periodic component
-    // 1) image - sComponent
-    compute_periodic_component(periodic, smooth, in, w, h, pd);
-    // 2) fft
-    do_fft_real(phat, periodic, w, h, pd);
-    // 3) zero-padding
-    upsampling_fourier(phat_zoom, phat, w, h, wout, hout, pd, 1);
-    // 4) fft inverse
-    do_ifft_real(periodic, phat_zoom, wout, hout, pd);
+    // memory allocation (half spectrum of the zoomed periodic component)
+    fft_complex *phat = FFTW(malloc)((wout/2+1)*hout*pd*sizeof*phat);
+
+    // DFT of the periodic component (at the beginning of the zoomed spectrum)
+    compute_periodic_fourier(phat, in, w, h, pd);
+
+    // zoomed periodic component
+    // 1) zero-padding (in place)
+    upsampling_fourier(phat, phat, w, h, wout, hout, pd, 1);
+    // 2) fft inverse
+    do_ifft_real(periodic, phat, wout, hout, pd);
 
     // free memory
-    fftw_free(shat);
-    fftw_free(phat);
-    fftw_free(phat_zoom);
+    FFTW(free)(phat);
+
+    // smooth component (image - pComponent)
+    for (int l = 0; l < pd; l++)
+        for (int j = 0; j < h; j++)
+            for (int i = 0; i < w; i++)
+                smooth[i + j*w + l*w*h] = in[i + j*w + l*w*h]
+                    - periodic[zoom*i + zoom*j*wout + l*wout*hout];
 }
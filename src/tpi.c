@@ -23,16 +23,170 @@
 #include <fftw3.h>
 
 #include "fft_core.h"
+// nfft3mp.h defines FFTW() for the same precision
+#undef FFTW
+#ifdef SINGLE_PRECISION
+#define NFFT_PRECISION_SINGLE
+#else
 #define NFFT_PRECISION_DOUBLE
+#endif
 #include "external/nfft-3.5.0/include/nfft3mp.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "tpi.h"
+
+// Default oversampling factor and cut-off of the NFFT window
 #define N_MULTIPL 2
 #define M_POLYDEG 6
 
+// Parameters tried by the automatic selection
+#define TPI_MAX_CUTOFF 16
+static const double tpi_oversamplings[] = {1.25, 1.5, 2, 3, 4};
+
+// Environment variable used when no precomputation policy is given
+#define TPI_PRECOMPUTE_ENV "TPI_PRECOMPUTE"
+
+// TPI context: NFFT plans for a given bandwidth and number of nodes
+// The plans (with their precomputed window tables) are kept between the calls
+// and the node-dependent precomputations are only done when the nodes change
+// The first plan owns the positions and the window tables of the nodes, which
+// are shared by the other plans (one per channel evaluated concurrently)
+typedef struct {
+    int nx, ny, numPixels;
+    int symmetric;    // spectrum with the frequencies n/2 of the even sizes
+    TPIPrecompute precompute;
+    double oversampling; // oversampling factor of the NFFT
+    int cutoff;          // cut-off of the NFFT window
+    int in_use;       // the context is used by a call
+    int has_nodes;    // the nodes x, y have been set
+    double *x, *y;    // nodes of the plan (DFT convention)
+    double *sx, *sy;  // sin(pi x) and sin(pi y) for the real convention adjustment
+    int nplans;
+    NFFT(plan) **plans;
+} tpi_context;
+
+// Process-wide context cache
+static tpi_context **tpi_cache = NULL;
+static int tpi_cache_size = 0;
+
+// Precomputation policy
+static TPIPrecompute tpi_precompute = TPI_PRECOMPUTE_NONE;
+static int tpi_precompute_set = 0;
+
+// Oversampling factor and cut-off of the NFFT window, or error tolerance
+// from which they are selected (automatic mode if positive)
+static double tpi_oversampling = N_MULTIPL;
+static int tpi_cutoff = M_POLYDEG;
+static double tpi_tolerance = 0;
+static int tpi_verbose = 0;
+
+// Select the precomputation of the NFFT window between none, psi and full
+// (none: the window is evaluated on the fly,
+//  psi: 2(2m+2) window values per node (PRE_PSI),
+//  full: (2m+2)^2 window values and indices per node (PRE_FULL_PSI))
+// Return 0 if the policy is unknown
+int set_tpi_precompute(const char *policy)
+{
+    if ( strcmp(policy, "none") == 0 )
+        tpi_precompute = TPI_PRECOMPUTE_NONE;
+    else if ( strcmp(policy, "psi") == 0 )
+        tpi_precompute = TPI_PRECOMPUTE_PSI;
+    else if ( strcmp(policy, "full") == 0 )
+        tpi_precompute = TPI_PRECOMPUTE_FULL_PSI;
+    else {
+        fprintf(stderr, "Unknown TPI precomputation %s (using none)\n", policy);
+        tpi_precompute = TPI_PRECOMPUTE_NONE;
+        return 0;
+    }
+    tpi_precompute_set = 1;
+    return 1;
+}
+
+// Set the oversampling factor (at least 1) and the cut-off (at least 1)
+// of the NFFT window (a zero parameter keeps its current value)
+// Return 0 if the parameters are not valid
+int set_tpi_parameters(double oversampling, int cutoff)
+{
+    oversampling = oversampling ? oversampling : tpi_oversampling;
+    cutoff = cutoff ? cutoff : tpi_cutoff;
+    if ( oversampling < 1 || cutoff < 1 || cutoff > TPI_MAX_CUTOFF ) {
+        fprintf(stderr, "Invalid TPI parameters (oversampling %g, cut-off %i)\n",
+                oversampling, cutoff);
+        return 0;
+    }
+    tpi_oversampling = oversampling;
+    tpi_cutoff = cutoff;
+    tpi_verbose = 1;
+    return 1;
+}
+
+// Set the error tolerance from which the oversampling factor and the cut-off
+// are selected (the smallest parameters with an error bound below it)
+// A non-positive tolerance disables the automatic selection
+void set_tpi_tolerance(double tolerance)
+{
+    tpi_tolerance = tolerance;
+    tpi_verbose = 1;
+}
+
+// Current precomputation policy (read from the environment variable
+// TPI_PRECOMPUTE unless it has been set before)
+TPIPrecompute get_tpi_precompute(void)
+{
+    #ifdef _OPENMP
+    #pragma omp critical (tpi_cache)
+    #endif
+    {
+        const char *env;
+        if ( !tpi_precompute_set && (env = getenv(TPI_PRECOMPUTE_ENV)) && *env )
+            set_tpi_precompute(env);
+        tpi_precompute_set = 1;
+    }
+    return tpi_precompute;
+}
+
+// Lower the precomputation policy to at most a given one (memory budget)
+void limit_tpi_precompute(TPIPrecompute precompute)
+{
+    static const char *names[] = {"none", "psi", "full"};
+    if ( get_tpi_precompute() <= precompute )
+        return;
+
+    #ifdef _OPENMP
+    #pragma omp critical (tpi_cache)
+    #endif
+    if ( tpi_precompute > precompute ) {
+        fprintf(stderr, "Precomputation of the TPI window lowered from %s to %s"
+                " (memory budget)\n", names[tpi_precompute], names[precompute]);
+        tpi_precompute = precompute;
+    }
+}
+
+// Compute the correspondence between a position x in [0,n) (DFT convention)
+// and a position in [-1/2,1/2) (NDFT convention), scale is 1/n
+static double ndft_position(double x, double scale)
+{
+    //rescale
+    double e = x*scale;
+
+    // periodization
+    while ( e < 0 )
+        e++;
+    while ( e >= 1 )
+        e--;
+
+    // set to [-0.5,0.5] and do not forget the minus in the NDFT convention
+    return (e <= 0.5) ? - e : 1 - e;
+}
+
 // Compute the correspondences between positions in [0,nx) x [0,ny) (DFT convention)
 // and positions in [-1/2,1/2)^2 (NDFT convention)
+// For a 1D plan only the positions x in [0,nx) are used
 // See https://www.ipol.im/pub/art/2019/273/ (Line 2 of Algorithm 2 (or Equation (51)).
-static void init_position(int nx, int ny, double *x, double *y, int numPixels, nfft_plan *my_plan)
+static void init_position(int nx, int ny, double *x, double *y, int numPixels, NFFT(plan) *my_plan)
 {
     // sanity check
     assert((int) my_plan->M_total == numPixels);
@@ -41,28 +195,14 @@ static void init_position(int nx, int ny, double *x, double *y, int numPixels, n
     double scaleX = 1.0/((double) nx);
     double scaleY = 1.0/((double) ny);
 
-    double ex, ey;
-    for (int i = 0; i < numPixels; i++) {
-        //rescale
-        ex = x[i]*scaleX;
-        ey = y[i]*scaleY;
-
-        // periodization
-        while ( ex < 0 )
-            ex++;
-        while ( ey < 0 )
-            ey++;
-        while ( ex >= 1 )
-            ex--;
-        while ( ey >= 1 )
-            ey--;
-
-        // set to [-0.5,0.5] and do not forget the minus in the NDFT convention
-        ex = (ex <= 0.5) ? - ex : 1 - ex;
-        ey = (ey <= 0.5) ? - ey : 1 - ey;
-        my_plan->x[2*i]   =  ey;
-        my_plan->x[2*i+1] =  ex;
-    }
+    if ( my_plan->d == 1 )
+        for (int i = 0; i < numPixels; i++)
+            my_plan->x[i] = ndft_position(x[i], scaleX);
+    else
+        for (int i = 0; i < numPixels; i++) {
+            my_plan->x[2*i]   = ndft_position(y[i], scaleY);
+            my_plan->x[2*i+1] = ndft_position(x[i], scaleX);
+        }
 }
 
 // Compute the next power of 2
@@ -78,14 +218,75 @@ static unsigned long next_power_of_2(unsigned long v)
    return v;
 }
 
-// Initialization of the NFFT plan
-// The values Xband, Yband are the sizes of the spectrum for the input function,
-// m: is the parameter for selection the interpolation function
-//
-// AFTER INITIALIZING THE KNOTS ARE FIXED, ONLY CAN BE CHANGED THE COORDINATES
-static void irregular_sampling_init(long Xband, long Yband, long num_knots, double n_multiplier, int m, nfft_plan *my_plan) {
-    int my_N[2], my_n[2];
+// Oversampling factor of the NFFT in one dimension
+// (the size of the oversampled grid is a power of 2)
+static double effective_oversampling(long band, double oversampling)
+{
+    long N = (band == 1) ? 1 : 2*((band+1)/2);
+    return next_power_of_2((int)(band*oversampling))/(double) N;
+}
+
+// Error bound of the NFFT with the Kaiser-Bessel window, relative to the
+// l1 norm of the Fourier coefficients (sum of the bounds of the two dimensions)
+// See Potts, Steidl and Tasche, Fast Fourier transforms for nonequispaced
+// data: a tutorial (2001)
+static double tpi_error_bound(long Xband, long Yband, double oversampling, int m)
+{
+    double bound = 0;
+    double sigma[2] = {effective_oversampling(Xband, oversampling),
+                       effective_oversampling(Yband, oversampling)};
+    long band[2] = {Xband, Yband};
+    for (int d = 0; d < 2; d++) {
+        // a dimension of size 1 is not transformed (1D plan)
+        if ( band[d] == 1 )
+            continue;
+        double b = sqrt(1 - 1/sigma[d]);
+        bound += 4*M_PI*(sqrt(m) + m)*sqrt(b)*exp(-2*M_PI*m*b);
+    }
+    return bound;
+}
 
+// Select the parameters of the NFFT for a bandwidth nx x ny and numPixels nodes
+// In automatic mode, for each oversampling factor the smallest cut-off with an
+// error bound below the tolerance is taken, and the pair with the lowest
+// estimated cost (FFT of the oversampled grid and window footprint) is selected
+static void select_tpi_parameters(int nx, int ny, int numPixels, double *oversampling, int *cutoff)
+{
+    *oversampling = tpi_oversampling;
+    *cutoff = tpi_cutoff;
+    if ( tpi_tolerance <= 0 )
+        return;
+
+    double best = -1;
+    int noversamplings = sizeof(tpi_oversamplings)/sizeof(*tpi_oversamplings);
+    for (int k = 0; k < noversamplings; k++) {
+        double sigma = tpi_oversamplings[k];
+        int m = 1;
+        while ( m <= TPI_MAX_CUTOFF && tpi_error_bound(nx, ny, sigma, m) > tpi_tolerance )
+            m++;
+        if ( m > TPI_MAX_CUTOFF )
+            continue;
+        double n = effective_oversampling(nx, sigma)*nx;
+        double footprint = 2*m+2;
+        if ( ny > 1 ) {
+            n *= effective_oversampling(ny, sigma)*ny;
+            footprint *= 2*m+2;
+        }
+        double cost = n*log2(n) + (double) numPixels*footprint;
+        if ( best < 0 || cost < best ) {
+            best = cost;
+            *oversampling = sigma;
+            *cutoff = m;
+        }
+    }
+    if ( best < 0 )
+        fprintf(stderr, "TPI tolerance %g cannot be reached\n", tpi_tolerance);
+}
+
+// Sizes my_N of the spectrum and my_n of the oversampled grid of the NFFT plan
+// for a spectrum of size Xband x Yband (see irregular_sampling_init)
+static void plan_sizes(long Xband, long Yband, double n_multiplier, int symmetric,
+                       int my_N[2], int my_n[2]) {
     // Nasty workarround for the NFFT problem with odd bandwidths
     // THE SOLUTION: is to extend by 1 the spectral dimension that
     // is odd by allocation zeros. It will not affect the result
@@ -100,8 +301,36 @@ static void irregular_sampling_init(long Xband, long Yband, long num_knots, doub
     else
         my_N[1] = (int) ceil((float) Xband/2)*2;
 
+    // the symmetric spectrum of an even size n has the frequencies -n/2 to n/2
+    if ( symmetric && Yband > 1 && !(Yband%2) )
+        my_N[0] += 2;
+    if ( symmetric && Xband > 1 && !(Xband%2) )
+        my_N[1] += 2;
+
     my_n[0] = next_power_of_2((int)(Yband*n_multiplier));
     my_n[1] = next_power_of_2((int)(Xband*n_multiplier));
+    for (int d = 0; d < 2; d++)
+        if ( my_n[d] < my_N[d] )
+            my_n[d] = next_power_of_2(my_N[d]);
+}
+
+// Initialization of the NFFT plan
+// The values Xband, Yband are the sizes of the spectrum for the input function
+// (a 1D plan is used when Yband is 1),
+// symmetric: the even dimensions are extended by 2 to hold the frequencies
+// -n/2 and n/2 (the size of the oversampled grid is not changed),
+// m: is the parameter for selection the interpolation function
+// precompute: precomputation of the window (the Fourier transform of the
+// window is always precomputed),
+// shared: plan whose positions and window tables are used (NULL if owned)
+//
+// AFTER INITIALIZING THE KNOTS ARE FIXED, ONLY CAN BE CHANGED THE COORDINATES
+static void irregular_sampling_init(long Xband, long Yband, long num_knots, double n_multiplier, int m,
+                                    int symmetric, TPIPrecompute precompute,
+                                    const NFFT(plan) *shared, NFFT(plan) *my_plan) {
+    // sizes of the spectrum and of the oversampled grid
+    int my_N[2], my_n[2];
+    plan_sizes(Xband, Yband, n_multiplier, symmetric, my_N, my_n);
 
     // window function m
     // -----------------------
@@ -115,81 +344,540 @@ static void irregular_sampling_init(long Xband, long Yband, long num_knots, doub
     // M (irregular knots to evaluate),
     // n (number of fourier coefficients computed for the interpolation, one for each dimension) ,
     // m (cut off parameter in time domain)
-    nfft_init_guru(my_plan, 2, my_N, num_knots,  my_n, m,
-                   MALLOC_X| MALLOC_F_HAT|
-                   MALLOC_F| FFTW_INIT| FFT_OUT_OF_PLACE,
-                   FFTW_ESTIMATE| FFTW_DESTROY_INPUT);
+    unsigned flags = PRE_PHI_HUT| MALLOC_F_HAT| MALLOC_F| FFTW_INIT| FFT_OUT_OF_PLACE;
+    if ( !shared )
+        flags |= MALLOC_X;
+    if ( !shared && precompute == TPI_PRECOMPUTE_PSI )
+        flags |= PRE_PSI;
+    else if ( !shared && precompute == TPI_PRECOMPUTE_FULL_PSI )
+        flags |= PRE_FULL_PSI;
+
+    // the FFTW planner (called by the NFFT) is not thread-safe
+    int d = (Yband == 1) ? 1 : 2;
+    #ifdef _OPENMP
+    #pragma omp critical (fftw_planner)
+    #endif
+    NFFT(init_guru)(my_plan, d, my_N + 2 - d, num_knots, my_n + 2 - d, m, flags,
+                    FFTW_ESTIMATE| FFTW_DESTROY_INPUT);
+
+    // the window tables are not freed by finalize_plan for a shared plan
+    if ( shared ) {
+        my_plan->x = shared->x;
+        my_plan->psi = shared->psi;
+        my_plan->psi_index_g = shared->psi_index_g;
+        my_plan->psi_index_f = shared->psi_index_f;
+        my_plan->flags |= shared->flags & (PRE_PSI| PRE_FULL_PSI);
+    }
+}
+
+// Free a NFFT plan initialized by irregular_sampling_init
+static void finalize_plan(NFFT(plan) *my_plan, int shared)
+{
+    if ( shared )
+        my_plan->flags &= ~(PRE_PSI| PRE_FULL_PSI);
+    NFFT(finalize)(my_plan);
+}
+
+// Get a context for the bandwidth nx x ny and numPixels nodes with at least
+// nplans plans from the cache (with a symmetric spectrum if symmetric is set)
+// The context is created if needed and marked as used until release_tpi_context
+static tpi_context *get_tpi_context(int nx, int ny, int numPixels, int symmetric,
+                                    int nplans)
+{
+    TPIPrecompute precompute = get_tpi_precompute();
+    double oversampling;
+    int cutoff;
+    select_tpi_parameters(nx, ny, numPixels, &oversampling, &cutoff);
+    tpi_context *ctx = NULL;
+
+    #ifdef _OPENMP
+    #pragma omp critical (tpi_cache)
+    #endif
+    {
+        for (int n = 0; n < tpi_cache_size && !ctx; n++)
+            if ( !tpi_cache[n]->in_use && tpi_cache[n]->nx == nx
+                 && tpi_cache[n]->ny == ny && tpi_cache[n]->numPixels == numPixels
+                 && tpi_cache[n]->symmetric == symmetric
+                 && tpi_cache[n]->precompute == precompute
+                 && tpi_cache[n]->oversampling == oversampling
+                 && tpi_cache[n]->cutoff == cutoff )
+                ctx = tpi_cache[n];
+        if ( !ctx ) {
+            ctx = malloc(sizeof*ctx);
+            *ctx = (tpi_context) {.nx = nx, .ny = ny, .numPixels = numPixels,
+                                  .symmetric = symmetric, .precompute = precompute,
+                                  .oversampling = oversampling, .cutoff = cutoff};
+            tpi_cache = realloc(tpi_cache, (tpi_cache_size+1)*sizeof*tpi_cache);
+            tpi_cache[tpi_cache_size++] = ctx;
+        }
+        ctx->in_use = 1;
+    }
+
+    // plans initialization (outside of the critical section)
+    if ( nplans > ctx->nplans ) {
+        ctx->plans = realloc(ctx->plans, nplans*sizeof*ctx->plans);
+        for (int p = ctx->nplans; p < nplans; p++) {
+            ctx->plans[p] = malloc(sizeof*ctx->plans[p]);
+            irregular_sampling_init(nx, ny, numPixels, oversampling, cutoff, symmetric,
+                                    precompute, p ? ctx->plans[0] : NULL, ctx->plans[p]);
+        }
+        ctx->nplans = nplans;
+    }
+    if ( !ctx->x ) {
+        if ( tpi_verbose )
+            printf("TPI of a %ix%i image with oversampling %g and cut-off %i"
+                   " (relative error bound %.2e)\n", nx, ny, oversampling, cutoff,
+                   tpi_error_bound(nx, ny, oversampling, cutoff));
+        ctx->x = malloc(numPixels*sizeof*ctx->x);
+        ctx->y = malloc(numPixels*sizeof*ctx->y);
+        if ( !symmetric && !(nx%2) && !(ny%2) ) {
+            ctx->sx = malloc(numPixels*sizeof*ctx->sx);
+            ctx->sy = malloc(numPixels*sizeof*ctx->sy);
+        }
+    }
+
+    return ctx;
+}
+
+// Release a context obtained by get_tpi_context
+static void release_tpi_context(tpi_context *ctx)
+{
+    #ifdef _OPENMP
+    #pragma omp critical (tpi_cache)
+    #endif
+    ctx->in_use = 0;
+}
+
+// Set the nodes of a context (y is not used by a 1D plan)
+// The node-dependent precomputations are skipped if the nodes are unchanged
+static void set_tpi_nodes(tpi_context *ctx, const double *x, const double *y)
+{
+    size_t size = ctx->numPixels*sizeof(double);
+    NFFT(plan) *plan = ctx->plans[0];
+    int d = plan->d;
+    if ( ctx->has_nodes && !memcmp(ctx->x, x, size)
+         && (d == 1 || !memcmp(ctx->y, y, size)) )
+        return;
+
+    memcpy(ctx->x, x, size);
+    if ( d == 2 )
+        memcpy(ctx->y, y, size);
+    init_position(ctx->nx, ctx->ny, ctx->x, ctx->y, ctx->numPixels, plan);
+    if ( plan->flags & PRE_ONE_PSI )
+        NFFT(precompute_one_psi)(plan);
+
+    // factors of the real convention adjustment (even sizes)
+    if ( ctx->sx )
+        for (int i = 0; i < ctx->numPixels; i++) {
+            ctx->sx[i] = sin(M_PI*x[i]);
+            ctx->sy[i] = sin(M_PI*y[i]);
+        }
+    ctx->has_nodes = 1;
+}
+
+// Free the TPI contexts
+void clean_tpi(void)
+{
+    flush_tpi_cache();
+    free(tpi_cache);
+    tpi_cache = NULL;
+}
+
+// Free the NFFT plans kept between the calls which are not used by a call
+void flush_tpi_cache(void)
+{
+    #ifdef _OPENMP
+    #pragma omp critical (tpi_cache)
+    #endif
+    {
+        int kept = 0;
+        for (int n = 0; n < tpi_cache_size; n++) {
+            tpi_context *ctx = tpi_cache[n];
+            if ( ctx->in_use ) {
+                tpi_cache[kept++] = ctx;
+                continue;
+            }
+            for (int p = ctx->nplans - 1; p >= 0; p--) {
+                finalize_plan(ctx->plans[p], p > 0);
+                free(ctx->plans[p]);
+            }
+            free(ctx->plans);
+            free(ctx->x);
+            free(ctx->y);
+            free(ctx->sx);
+            free(ctx->sy);
+            free(ctx);
+        }
+        tpi_cache_size = kept;
+    }
 }
 
 // Compute the irregular samples of f given in Equation (50) from fhat using the NFFT algorithm
 // When a dimension is odd an extra frequency with zeros is added
-// The coefficients in fhat cannot be used directly from the FFTW as the fftshift function must be applied
+// The coefficients are read from the half spectrum fhat given by the FFTW and
+// reordered on the fly (fftshift) to have the right ordering of polynomial coefficients
 // See https://www.ipol.im/pub/art/2019/273/ (Line 5 to 7 of Algorihtm 2)
-static void irregular_sampling_fourier(long nx, long ny, const fftw_complex *fhat, double *out, nfft_plan *my_plan)
+static void irregular_sampling_fourier(long nx, long ny, const fft_complex *fhat, double *out, NFFT(plan) *my_plan)
 {
     // nx and ny are the bandwith of the input transform fhat
     long numknots = my_plan->M_total;
-    long Yband = my_plan->N[0];
-    long Xband = my_plan->N[1];
+    long Yband = (my_plan->d == 2) ? my_plan->N[0] : 1;
+    long Xband = my_plan->N[my_plan->d-1];
+
+    // the values of difx are 0 or 1, depending if we added or not
+    // an extra frequency (with zeros)
+    long difx = Xband - nx;
+    long dify = Yband - ny;
+
+    // indices for the inverse fftshift
+    long nx2 = nx/2;
+    long ny2 = ny/2;
+    long cx = (nx+1)/2;
+    long cy = (ny+1)/2;
 
     // load the fourier coefficients (Line 5 and Line 6 of Algorithm 2)
-    for (long i = 0; i < Xband; i++)
-        for (long j = 0; j < Yband; j++)  {
-            // the values of difx are 0 or 1, depending if we added or not
-            // an extra frequency (with zeros)
-            long difx = Xband - nx;
-            long dify = Yband - ny;
+    #ifdef _OPENMP
+    #pragma omp parallel for
+    #endif
+    for (long j = 0; j < Yband; j++)
+        for (long i = 0; i < Xband; i++)  {
             long pos = i + Xband *j;
-            long posIn = i - difx + nx * (j-dify);
-            if ( ((i-difx)>=0 ) && ((j-dify)>=0) )
-                    my_plan->f_hat[pos] = fhat[posIn];
+            long is = i - difx;
+            long js = j - dify;
+            if ( (is >= 0) && (js >= 0) ) {
+                long i2 = (is >= nx2) ? is - nx2 : is + cx;
+                long j2 = (js >= ny2) ? js - ny2 : js + cy;
+                my_plan->f_hat[pos] = hermitian_coefficient(fhat, i2, j2, nx, ny);
+            }
             else
-                    my_plan->f_hat[pos] = 0.0;
+                my_plan->f_hat[pos] = 0.0;
     }
 
     // execute NFFT
-    nfft_trafo(my_plan);
+    NFFT(trafo)(my_plan);
 
     // Extract the results and normalize the values
+    #ifdef _OPENMP
+    #pragma omp parallel for
+    #endif
     for (long i = 0; i < numknots; i++)
             out[i] = creal(my_plan->f[i]) / (nx*ny);
 }
 
+// Compute the irregular samples of two channels of f given in Equation (50)
+// with one complex NFFT (fhat2 may be NULL for a single channel)
+// The symmetric spectrum of the real convention (Equation (27)) is used: for an
+// even size the coefficient of the frequency n/2 is split between -n/2 and n/2.
+// The trigonometric polynomial of each channel is then real so that the packed
+// coefficients fhat1 + i fhat2 give the two channels in the real and the
+// imaginary parts of the result (no adjustment is needed)
+static void irregular_sampling_fourier_pair(long nx, long ny, const fft_complex *fhat1,
+                                            const fft_complex *fhat2, double *out1,
+                                            double *out2, NFFT(plan) *my_plan)
+{
+    long numknots = my_plan->M_total;
+    long Yband = (my_plan->d == 2) ? my_plan->N[0] : 1;
+    long Xband = my_plan->N[my_plan->d-1];
+
+    // load the fourier coefficients (the frequencies kx in [-nx/2,nx/2]
+    // and ky in [-ny/2,ny/2], the first ones of the odd extended sizes are zero)
+    #ifdef _OPENMP
+    #pragma omp parallel for
+    #endif
+    for (long j = 0; j < Yband; j++)
+        for (long i = 0; i < Xband; i++) {
+            long pos = i + Xband*j;
+            long kx = i - Xband/2;
+            long ky = j - Yband/2;
+            if ( labs(kx) > nx/2 || labs(ky) > ny/2 ) {
+                my_plan->f_hat[pos] = 0.0;
+                continue;
+            }
+            double w = 1;
+            if ( !(nx%2) && labs(kx) == nx/2 )
+                w *= 0.5;
+            if ( !(ny%2) && ny > 1 && labs(ky) == ny/2 )
+                w *= 0.5;
+            long i2 = (kx + nx) % nx;
+            long j2 = (ky + ny) % ny;
+            fft_complex c = hermitian_coefficient(fhat1, i2, j2, nx, ny);
+            if ( fhat2 )
+                c += I*hermitian_coefficient(fhat2, i2, j2, nx, ny);
+            my_plan->f_hat[pos] = w*c;
+        }
+
+    // execute NFFT
+    NFFT(trafo)(my_plan);
+
+    // Extract the results and normalize the values
+    #ifdef _OPENMP
+    #pragma omp parallel for
+    #endif
+    for (long i = 0; i < numknots; i++) {
+        out1[i] = creal(my_plan->f[i]) / (nx*ny);
+        if ( out2 )
+            out2[i] = cimag(my_plan->f[i]) / (nx*ny);
+    }
+}
+
 // Transformation of an image using trigonometric polynomial interpolation
+// The channels are evaluated concurrently with one plan per channel (sharing
+// the node-dependent precomputations) and the threads are shared between the
+// channels and the NFFT of each channel
 // See https://www.ipol.im/pub/art/2019/273/ (Line 2 to 7 of Algorithm 2)
 void interpolate_at_locations_nfft(double *out, const double *in, int nx, int ny, int nz,
                                    double *x, double *y, int numPixels, int interp) {
-    // plan initialization
-    NFFT(plan) my_plan;
-    irregular_sampling_init(nx, ny, numPixels, N_MULTIPL, M_POLYDEG, &my_plan);
-    init_position(nx, ny, x, y, numPixels, &my_plan);
+    // number of channels evaluated concurrently and threads of each NFFT
+    int nthreads = 1;
+    #ifdef _OPENMP
+    if ( !omp_in_parallel() )
+        nthreads = omp_get_max_threads();
+    #endif
+
+    // the pairs of channels are packed in one transform (symmetric spectrum)
+    int packed = (nz > 1) && (interp || nx%2 || ny%2);
+    int ntransforms = packed ? (nz+1)/2 : nz;
+    int nplans = (ntransforms < nthreads) ? ntransforms : nthreads;
+    int inner = nthreads/nplans;
 
-    // allocate memory for fourier transform
-    fftw_complex *fhat = fftw_malloc(nx*ny*nz*sizeof*fhat);
-    fftw_complex *fshift = fftw_malloc(nx*ny*nz*sizeof*fshift);
+    // plans of the context (kept between the calls)
+    tpi_context *ctx = get_tpi_context(nx, ny, numPixels, packed, nplans);
+    set_tpi_nodes(ctx, x, y);
+
+    // allocate memory for fourier transform (half spectrum)
+    int nxh = nx/2+1;
+    fft_complex *fhat = FFTW(malloc)(nxh*ny*nz*sizeof*fhat);
 
     // compute DFT of the input
     do_fft_real(fhat, in, nx, ny, nz);
 
-    // fftshift (to have the right ordering of polynomial coefficients)
-    fftshift(fshift, fhat, nx, ny, nz);
-    free(fhat);
+    #ifdef _OPENMP
+    int levels = omp_get_max_active_levels();
+    if ( nplans > 1 && inner > 1 )
+        omp_set_max_active_levels(2);
+    #pragma omp parallel num_threads(nplans)
+    #endif
+    {
+        int p = 0;
+        #ifdef _OPENMP
+        p = omp_get_thread_num();
+        omp_set_num_threads(inner);
+        #endif
+        NFFT(plan) *plan = ctx->plans[p];
+
+        // evaluation of the interpolated values for each pair of channels
+        #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+        #endif
+        for(int t = 0; t < ntransforms; t++) {
+            if ( packed ) {
+                int l = 2*t;
+                int pair = (l+1 < nz);
+                irregular_sampling_fourier_pair(nx, ny, fhat + l*nxh*ny,
+                                                pair ? fhat + (l+1)*nxh*ny : NULL,
+                                                out + l*numPixels,
+                                                pair ? out + (l+1)*numPixels : NULL,
+                                                plan);
+                continue;
+            }
+
+            // evaluation of the interpolated values for each channel
+            int l = t;
+            double *o = out + l*numPixels;
+            irregular_sampling_fourier(nx, ny, fhat + l*nxh*ny, o, plan);
+
+            // real convention adjustment using Equation (27)
+            if( interp && !(nx%2) && !(ny%2) ) {
+                double hf = creal(fhat[nx/2 + (ny/2)*nxh + l*nxh*ny])/(nx*ny);
+                const double *sx = ctx->sx, *sy = ctx->sy;
+                #ifdef _OPENMP
+                #pragma omp parallel for
+                #endif
+                for(int i = 0; i < numPixels; i++)
+                    o[i] += hf*sx[i]*sy[i];
+            }
+        }
+    }
+    #ifdef _OPENMP
+    omp_set_max_active_levels(levels);
+    #endif
+
+    // the context can be used by another call
+    release_tpi_context(ctx);
+
+    //free memory
+    FFTW(free)(fhat);
+}
+
+// Memory (in bytes) used by interpolate_at_locations_nfft with a given
+// precomputation policy: spectrum of the input, arrays of each plan (spectrum,
+// oversampled grids and values) and arrays shared by the plans of the context
+// (nodes, positions and window tables)
+double tpi_memory(int nx, int ny, int nz, int numPixels, int interp, TPIPrecompute precompute)
+{
+    int nthreads = 1;
+    #ifdef _OPENMP
+    if ( !omp_in_parallel() )
+        nthreads = omp_get_max_threads();
+    #endif
+    int packed = (nz > 1) && (interp || nx%2 || ny%2);
+    int ntransforms = packed ? (nz+1)/2 : nz;
+    int nplans = (ntransforms < nthreads) ? ntransforms : nthreads;
+
+    double oversampling;
+    int cutoff;
+    select_tpi_parameters(nx, ny, numPixels, &oversampling, &cutoff);
+    int my_N[2], my_n[2];
+    plan_sizes(nx, ny, oversampling, packed, my_N, my_n);
+    int d = (ny == 1) ? 1 : 2;
+    double N = (double) my_N[0]*my_N[1], n = (double) my_n[0]*my_n[1];
+    double M = numPixels, footprint = 2*cutoff+2;
+
+    // arrays of each plan (f_hat, g1, g2, f and phi_hut)
+    double plan = sizeof(fft_complex)*(N + 2*n + M) + sizeof(fft_real)*(my_N[0] + my_N[1]);
+
+    // shared arrays (x and the window tables of the first plan, nodes of the context)
+    double shared = sizeof(fft_real)*d*M;
+    if ( precompute == TPI_PRECOMPUTE_PSI )
+        shared += sizeof(fft_real)*M*d*footprint;
+    else if ( precompute == TPI_PRECOMPUTE_FULL_PSI ) {
+        double lprod = (d == 1) ? footprint : footprint*footprint;
+        shared += (sizeof(fft_real) + sizeof(NFFT_INT))*M*lprod + sizeof(NFFT_INT)*M;
+    }
+    int nnodes = (!packed && !(nx%2) && !(ny%2)) ? 4 : 2;
+    shared += sizeof(double)*nnodes*M;
+
+    return sizeof(fft_complex)*(double)(nx/2+1)*ny*nz + nplans*plan + shared;
+}
+
+// Check if the nodes x are of the form x0 + s*i with an integer step s dividing n
+// Return the step (0 otherwise)
+static int uniform_step(const double *x, int nodes, int n)
+{
+    if ( n == 1 )
+        return 1;
+    int s = (nodes > 1) ? (int) round(x[1] - x[0]) : 1;
+    if ( s < 1 || n % s )
+        return 0;
+    for (int i = 1; i < nodes; i++)
+        if ( fabs(x[i] - (x[0] + s*i)) > 1e-9*(1 + fabs(x[i])) )
+            return 0;
+    return s;
+}
+
+// Evaluate howmany 1D trigonometric polynomials at the nodes x (DFT convention)
+// out[t*odist + i*ostride] = sum_k c[t*cdist + (k mod n)*cstride] exp(2 i pi k x[i]/n)
+// with the frequencies -n/2 <= k < n - n/2 (same as the 2D NFFT)
+// For nodes x0 + s*i with an integer step s dividing n the values are given
+// by a DFT of size n/s of the folded and phase shifted coefficients,
+// otherwise a 1D NFFT is used
+static void sampling_1d(fft_complex *out, int odist, int ostride,
+                        const fft_complex *c, int cdist, int cstride,
+                        int n, int howmany, const double *x, int nodes)
+{
+    int kmin = -(n/2);
+    int s = uniform_step(x, nodes, n);
+    if ( s ) {
+        int M = n/s;
+
+        // phase shift of the first node
+        fft_complex *phase = malloc(n*sizeof*phase);
+        for (int k = kmin; k < kmin + n; k++)
+            phase[k - kmin] = cexp(2*I*M_PI*k*(x[0]/n));
+
+        // fold the coefficients (the nodes x0 + s*i only see k mod n/s)
+        fft_complex *a = FFTW(malloc)(M*howmany*sizeof*a);
+        #ifdef _OPENMP
+        #pragma omp parallel for
+        #endif
+        for (int t = 0; t < howmany; t++) {
+            fft_complex *at = a + t*M;
+            for (int q = 0; q < M; q++)
+                at[q] = 0;
+            for (int k = kmin; k < kmin + n; k++) {
+                int q = (k + n) % n;
+                at[q % M] += c[t*cdist + q*cstride]*phase[k - kmin];
+            }
+        }
+
+        // the values are M-periodic in i
+        do_dft_rows(a, M, howmany, FFTW_BACKWARD);
+        for (int t = 0; t < howmany; t++)
+            for (int i = 0; i < nodes; i++)
+                out[t*odist + i*ostride] = a[t*M + i % M];
+
+        free(phase);
+        FFTW(free)(a);
+    }
+    else {
+        tpi_context *ctx = get_tpi_context(n, 1, nodes, 0, 1);
+        set_tpi_nodes(ctx, x, NULL);
+        NFFT(plan) *plan = ctx->plans[0];
+        int N = plan->N[0];
+        for (int t = 0; t < howmany; t++) {
+            // coefficients in the NFFT order (an odd size is extended by a zero)
+            for (int p = 0; p < N; p++) {
+                int k = p - N/2;
+                plan->f_hat[p] = (k < kmin) ? 0 : c[t*cdist + ((k + n) % n)*cstride];
+            }
+            NFFT(trafo)(plan);
+            for (int i = 0; i < nodes; i++)
+                out[t*odist + i*ostride] = plan->f[i];
+        }
+        release_tpi_context(ctx);
+    }
+}
+
+// Transformation of an image using trigonometric polynomial interpolation
+// at the locations of the tensor grid xs x ys (the output is a nxo x nyo image)
+// The trigonometric polynomial is evaluated by 1D transforms along the rows
+// and then along the columns, which gives the same values as
+// interpolate_at_locations_nfft (phase shifts for translations)
+void interpolate_separable_nfft(double *out, const double *in, int nx, int ny, int nz,
+                                const double *xs, int nxo, const double *ys, int nyo,
+                                int interp) {
+    int nxh = nx/2+1;
+    int numPixels = nxo*nyo;
+
+    // allocate memory for fourier transform (half spectrum), the full
+    // spectrum of a channel and the two passes
+    fft_complex *fhat = FFTW(malloc)(nxh*ny*nz*sizeof*fhat);
+    fft_complex *f = malloc(nx*ny*sizeof*f);
+    fft_complex *g = malloc(nxo*ny*sizeof*g);
+    fft_complex *v = malloc(nxo*nyo*sizeof*v);
+
+    // compute DFT of the input
+    do_fft_real(fhat, in, nx, ny, nz);
 
-    // evaluation of the interpolated values for each channel
     for(int l = 0; l < nz; l++) {
-        irregular_sampling_fourier(nx, ny, fshift + l*nx*ny, out + l*numPixels, &my_plan);
+        const fft_complex *fh = fhat + l*nxh*ny;
+        for (int j = 0; j < ny; j++)
+            for (int i = 0; i < nx; i++)
+                f[i + j*nx] = hermitian_coefficient(fh, i, j, nx, ny);
+
+        // evaluation at the abscissas for each row of frequencies
+        // and at the ordinates for each column of the result
+        sampling_1d(g, nxo, 1, f, nx, 1, nx, ny, xs, nxo);
+        sampling_1d(v, 1, nxo, g, 1, nxo, ny, nxo, ys, nyo);
+
+        double *o = out + l*numPixels;
+        for (int k = 0; k < numPixels; k++)
+            o[k] = creal(v[k]) / (nx*ny);
 
         // real convention adjustment using Equation (27)
         if( interp && !(nx%2) && !(ny%2) ) {
-            double hf = creal(fshift[l*nx*ny])/(nx*ny);
-            for(int i = 0; i < numPixels; i++)
-                out[i + l*numPixels] += hf*sin(M_PI*x[i])*sin(M_PI*y[i]);
+            double hf = creal(fh[nx/2 + (ny/2)*nxh])/(nx*ny);
+            for (int j = 0; j < nyo; j++) {
+                double hy = hf*sin(M_PI*ys[j]);
+                for (int i = 0; i < nxo; i++)
+                    o[i + j*nxo] += hy*sin(M_PI*xs[i]);
+            }
         }
     }
 
-    //cleanup
-    nfft_finalize(&my_plan);
-
     //free memory
-    free(fshift);
+    FFTW(free)(fhat);
+    free(f);
+    free(g);
+    free(v);
 }
@@ -17,8 +17,36 @@
 #ifndef TPI_H
 #define TPI_H
 
+// Precomputation of the NFFT window (memory/speed trade-off)
+typedef enum {
+    TPI_PRECOMPUTE_NONE = 0,     // window evaluated on the fly
+    TPI_PRECOMPUTE_PSI = 1,      // 2(2m+2) window values per node
+    TPI_PRECOMPUTE_FULL_PSI = 2  // (2m+2)^2 window values and indices per node
+} TPIPrecompute;
+
+// Select the precomputation of the NFFT window (none, psi or full)
+int set_tpi_precompute(const char *policy);
+// Set the oversampling factor and the cut-off of the NFFT window (0 keeps the current value)
+int set_tpi_parameters(double oversampling, int cutoff);
+// Select the smallest NFFT parameters with an error bound below a tolerance
+void set_tpi_tolerance(double tolerance);
+// Current precomputation of the NFFT window
+TPIPrecompute get_tpi_precompute(void);
+// Lower the precomputation of the NFFT window to at most a given one
+void limit_tpi_precompute(TPIPrecompute precompute);
+// Free the NFFT plans kept between the calls (before clean_fftw)
+void clean_tpi(void);
+// Free the NFFT plans kept between the calls which are not in use
+void flush_tpi_cache(void);
+// Memory (in bytes) used by the trigonometric polynomial interpolation of
+// nz channels of size nx x ny at numPixels locations
+double tpi_memory(int nx, int ny, int nz, int numPixels, int interp, TPIPrecompute precompute);
 // Transformation of an image using trigonometric polynomial interpolation
 void interpolate_at_locations_nfft(double *out, const double *in, int nx, int ny, int nz,
                                    double *x, double *y, int numPixels, int interp);
+// Transformation of an image using trigonometric polynomial interpolation on a tensor grid
+void interpolate_separable_nfft(double *out, const double *in, int nx, int ny, int nz,
+                                const double *xs, int nxo, const double *ys, int nyo,
+                                int interp);
 
 #endif